@@ -19,6 +19,7 @@
 #include "malloc.h"
 
 #define DLOG_LEVEL DLOG_ERR
+#define DLOG_MODULE "dpool"
 #include "dlog.h"
 
 #define STRINGIFY(x) #x
@@ -37,7 +38,8 @@ static void _abs_fname(
 static int _find_file(
     char const *poolpath,
     uint32_t *fidp,
-    bool (*cmpf)(uint32_t, uint32_t))
+    bool (*cmpf)(uint32_t, uint32_t),
+    uint32_t from)
 {
     vfs_DIR pool_dir = { 0 };
     vfs_dirent_t dirent = { 0 };
@@ -55,6 +57,7 @@ static int _find_file(
         uint32_t fid = strtoul(fname, &endptr, 16);
 
         if (*endptr != '\0') continue; // illegal file name
+        if (fid < from) continue;
 
         DDBG("found %s, %u\n", fname, fid);
 
@@ -80,7 +83,7 @@ static int _find_oldest(
     uint32_t *fid)
 {
     *fid = 0xffffFFFF;
-    return _find_file(pooldir, fid, _cmpf_older);
+    return _find_file(pooldir, fid, _cmpf_older, 0);
 }
 
 static int _find_newest(
@@ -88,7 +91,7 @@ static int _find_newest(
     uint32_t *fid)
 {
     *fid = 0;
-    return _find_file(pooldir, fid, _cmpf_newer);
+    return _find_file(pooldir, fid, _cmpf_newer, 0);
 }
 
 int dpool_drain(char const *pooldir)
@@ -119,7 +122,7 @@ int dpool_drain(char const *pooldir)
     return res;
 }
 
-int dpool_move_file(char const *pooldir, char const *name)
+int dpool_move_file(char const *pooldir, char const *name, uint32_t *fid)
 {
     if (!pooldir || !name) return -EINVAL;
 
@@ -139,6 +142,7 @@ int dpool_move_file(char const *pooldir, char const *name)
     DDBG("add %s\n", abs_fname);
 
     res = vfs_rename(name, abs_fname);
+    if (!res && fid) *fid = newest;
 
     return res;
 }
@@ -160,6 +164,37 @@ int dpool_get_oldest_file(char const *pooldir, char *namebuf, size_t buflen)
     return 0;
 }
 
+int dpool_get_next_file(char const *pooldir, uint32_t from, char *namebuf,
+                        size_t buflen, uint32_t *fid)
+{
+    if (!pooldir || !namebuf || !fid) return -EINVAL;
+
+    *fid = 0xffffFFFF;
+    int res = _find_file(pooldir, fid, _cmpf_older, from);
+    if (res) return res;
+
+    res = snprintf(namebuf, buflen, "%s/%0"TOSTRING(POOL_FNAME_MAX)"x",
+        pooldir, *fid);
+
+    if (res < 0) return -EINVAL;
+    if ((unsigned)res >= buflen) return -ENOSPC;
+
+    return 0;
+}
+
+int dpool_file_id(char const *name, uint32_t *fid)
+{
+    if (!name || !fid) return -EINVAL;
+
+    char const *fname = strrchr(name, '/');
+    fname = fname ? fname + 1 : name;
+
+    char *endptr;
+    *fid = strtoul(fname, &endptr, 16);
+
+    return (*fname && *endptr == '\0') ? 0 : -EINVAL;
+}
+
 int dpool_size(char const *pooldir)
 {
     if (!pooldir) return -EINVAL;
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+#include "dlog.h"
+#include "msg.h"
+#include "slotring.h"
+#include "thread.h"
+#include "xfa.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The modules, one entry per source file defining DLOG_MODULE */
+XFA_INIT(dlog_mod_t, dlog_mods);
+
+int dlog_set_level(char const *name, unsigned level, int flags)
+{
+    int cnt = 0;
+
+    for (unsigned i = 0; i < XFA_LEN(dlog_mod_t, dlog_mods); i++) {
+        dlog_mod_t *mod = &dlog_mods[i];
+        if (name && strcmp(name, mod->name)) continue;
+
+        if (flags & DLOGF_LOCAL) {
+            mod->level = level < mod->max_level ? level : mod->max_level;
+        }
+        if (flags & DLOGF_REMOTE) {
+            mod->rlevel = level < mod->max_rlevel ? level : mod->max_rlevel;
+        }
+        cnt++;
+    }
+
+    return cnt ? cnt : -ENOENT;
+}
+
+dlog_mod_t const *dlog_get_module(unsigned idx)
+{
+    if (idx >= XFA_LEN(dlog_mod_t, dlog_mods)) return NULL;
+    return &dlog_mods[idx];
+}
+
+/* The asynchronous output. The messages are formatted into the slots of the
+ * ring by the callers, and printed by the drain thread. */
+typedef struct {
+    slotring_slot_t hdr;
+    uint16_t len;
+    char line[DLOG_LINE_MAXLEN];
+} dlog_slot_t;
+
+static dlog_slot_t  _slots[DLOG_RING_LEN];
+static slotring_t   _ring = SLOTRING_INIT(_slots);
+static kernel_pid_t _drain_pid = KERNEL_PID_UNDEF;
+
+void dlog_printf(char const *fmt, ...)
+{
+    unsigned pos;
+    dlog_slot_t *slot = slotring_claim(&_ring, &pos);
+    if (!slot) return;
+
+    va_list args;
+    va_start(args, fmt);
+    int const len = vsnprintf(slot->line, sizeof(slot->line), fmt, args);
+    va_end(args);
+
+    if (len < 0) {
+        slot->len = 0;
+    } else if (len >= (int)sizeof(slot->line)) {
+        /* truncated, keep the line break */
+        slot->len = sizeof(slot->line) - 1;
+        slot->line[slot->len - 1] = '\n';
+    } else {
+        slot->len = len;
+    }
+
+    slotring_publish(&_ring, slot, pos);
+
+    kernel_pid_t const pid = _drain_pid;
+    if (pid != KERNEL_PID_UNDEF) {
+        msg_t msg = { 0 };
+        /* A failure means a wake-up is pending already */
+        msg_try_send(&msg, pid);
+    }
+}
+
+static void *_dlog_drain_thread(void *arg)
+{
+    (void)arg;
+
+    /* Only wake-ups are received, one pending is enough */
+    static msg_t msg_queue[2];
+    msg_init_queue(msg_queue, 2);
+    msg_t msg;
+
+    while (1) {
+        dlog_slot_t *slot;
+        while ((slot = slotring_peek(&_ring))) {
+            printf("%.*s", (int)slot->len, slot->line);
+            slotring_release(&_ring, slot);
+        }
+
+        unsigned const dropped = slotring_dropped(&_ring);
+        if (dropped) printf("dlog: %u messages dropped\n", dropped);
+
+        msg_receive(&msg);
+    }
+
+    return NULL;
+}
+
+int dlog_async_init(void)
+{
+    static char drain_stack[DLOG_DRAIN_STACKSIZE];
+
+    if (_drain_pid != KERNEL_PID_UNDEF) return 0;
+
+    int res = thread_create(
+        drain_stack,
+        sizeof(drain_stack),
+        DLOG_DRAIN_PRIO,
+        0,
+        _dlog_drain_thread,
+        NULL,
+        "dlog");
+
+    if (res < 0) return res;
+
+    _drain_pid = res;
+    return 0;
+}
+
+#ifdef MODULE_SHELL
+#include "shell.h"
+
+static char const * const _level_names[] = { "off", "err", "wrn", "inf", "dbg" };
+
+static int _parse_level(char const *arg)
+{
+    for (unsigned i = 0; i <= DLOG_DBG; i++) {
+        if (!strcmp(arg, _level_names[i])) return i;
+    }
+
+    char *end;
+    long const level = strtol(arg, &end, 10);
+    if (*end || level < 0 || level > DLOG_DBG) return -EINVAL;
+
+    return level;
+}
+
+static int _loglevel_cmd(int argc, char **argv)
+{
+    if (argc == 1) {
+        printf("%-16s %-9s %-9s\n", "module", "local", "remote");
+
+        dlog_mod_t const *mod;
+        for (unsigned i = 0; (mod = dlog_get_module(i)); i++) {
+            printf("%-16s %s (%s)  %s (%s)\n", mod->name,
+                _level_names[mod->level], _level_names[mod->max_level],
+                _level_names[mod->rlevel], _level_names[mod->max_rlevel]);
+        }
+        return 0;
+    }
+
+    int flags = DLOGF_LOCAL | DLOGF_REMOTE;
+    int level = -EINVAL;
+
+    if (argc == 4 && !strcmp(argv[2], "local"))  flags = DLOGF_LOCAL;
+    if (argc == 4 && !strcmp(argv[2], "remote")) flags = DLOGF_REMOTE;
+    if (argc == 3 || (argc == 4 && flags != (DLOGF_LOCAL | DLOGF_REMOTE))) {
+        level = _parse_level(argv[argc - 1]);
+    }
+
+    if (level < 0) {
+        printf("usage: %s [<module>|all [local|remote] off|err|wrn|inf|dbg]\n",
+            argv[0]);
+        return 1;
+    }
+
+    char const *name = strcmp(argv[1], "all") ? argv[1] : NULL;
+    if (dlog_set_level(name, level, flags) < 0) {
+        printf("no module %s\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
+
+SHELL_COMMAND(loglevel, "Show or set the runtime log levels", _loglevel_cmd);
+#endif /* MODULE_SHELL */
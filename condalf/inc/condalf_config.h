@@ -39,12 +39,204 @@
 #ifndef LTB_QUEUE_PRIO
 #define LTB_QUEUE_PRIO (THREAD_PRIORITY_MAIN - 2)
 #endif
+/**
+ * If the LTB publisher refuses a transfer because the server asked it to slow
+ * down, the publishing session is ended and resumed once the publisher accepts
+ * transfers again (see \ref transdrv_holdoff()), or after this many seconds if
+ * the publisher cannot tell. */
+#ifndef LTB_RESUME_DELAY
+#define LTB_RESUME_DELAY 30
+#endif
 /**
  * When using the asynchronous family of transfer functions, the publisher
- * executes the jobs on a serial queue. This is the priority of the thread
- * that processes this queue. */
+ * instances queue their jobs, which are then executed by a pool of worker
+ * threads. This is the priority of the worker threads. */
 #ifndef PUBLISHER_QUEUE_PRIO
 #define PUBLISHER_QUEUE_PRIO (THREAD_PRIORITY_MAIN - 1)
 #endif
+/**
+ * Number of publisher worker threads. With more than one worker, a server that
+ * doesn't respond only blocks the workers serving it (see \ref
+ * publ_init_t::max_inflight), while the others keep serving the remaining
+ * servers. */
+#ifndef PUBLISHER_NB_WORKERS
+#define PUBLISHER_NB_WORKERS 1
+#endif
+/**
+ * Stack size of a publisher worker thread. */
+#ifndef PUBLISHER_WORKER_STACKSIZE
+#define PUBLISHER_WORKER_STACKSIZE THREAD_STACKSIZE_MAIN
+#endif
+/**
+ * Default depth of the asynchronous job queue of a publisher instance.
+ *
+ * @see \ref publ_init_t::queue_len */
+#ifndef PUBLISHER_QUEUE_LEN
+#define PUBLISHER_QUEUE_LEN 4
+#endif
+/**
+ * Maximum number of queued jobs a publisher merges into a single transfer.
+ *
+ * @see \ref publ_init_t::coalesce_len */
+#ifndef PUBLISHER_COALESCE_JOBS_MAX
+#define PUBLISHER_COALESCE_JOBS_MAX 4
+#endif
+/**
+ * Seconds a pacing hint of the server (see \ref net_hint_t::min_interval)
+ * stays in force after the last response carrying it. Responses without the
+ * hint don't clear it, so it expires once the server stops sending it. */
+#ifndef PUBLISHER_PACING_HOLD
+#define PUBLISHER_PACING_HOLD 600
+#endif
+/**
+ * Minimum interval, in seconds, between two urgent flushes of a logger. Urgent
+ * records (\ref RECORDF_URGENT) within this interval are logged like the regular
+ * ones, so a flood of alarms cannot flood the network with tiny packs. */
+#ifndef LOGGER_URGENT_MIN_INTERVAL
+#define LOGGER_URGENT_MIN_INTERVAL 10
+#endif
+/**
+ * The loggers with a maximum latency (see \ref logg_init_t::max_latency) are
+ * flushed on expiry by a common housekeeping thread. This is its priority. */
+#ifndef LOGGER_HK_PRIO
+#define LOGGER_HK_PRIO (THREAD_PRIORITY_MAIN - 1)
+#endif
+/**
+ * Stack size of the logger housekeeping thread. */
+#ifndef LOGGER_HK_STACKSIZE
+#define LOGGER_HK_STACKSIZE THREAD_STACKSIZE_MAIN
+#endif
+/**
+ * Message queue length of the logger housekeeping thread. Should be at least
+ * the number of loggers with a maximum latency. MUST be power of 2. */
+#ifndef LOGGER_HK_QUEUE_LEN
+#define LOGGER_HK_QUEUE_LEN 4
+#endif
+/**
+ * Maximum number of substreams of a logger, see \ref logg_substream_create() */
+#ifndef LOGGER_SUBSTREAMS_MAX
+#define LOGGER_SUBSTREAMS_MAX 3
+#endif
+/**
+ * Number of packs a logger with \ref LOGGERF_AUTOTUNE measures before it
+ * reconsiders its record queue and encoding buffer sizes. */
+#ifndef LOGGER_AUTOTUNE_PACKS
+#define LOGGER_AUTOTUNE_PACKS 4
+#endif
+/**
+ * Default target pack fill ratio, in percent of the encoding buffer, see
+ * \ref logg_init_t::target_fill */
+#ifndef LOGGER_AUTOTUNE_TARGET_FILL
+#define LOGGER_AUTOTUNE_TARGET_FILL 90
+#endif
+/**
+ * Lower bounds of the sizes chosen by \ref LOGGERF_AUTOTUNE. The queue length
+ * MUST be power of 2. */
+#ifndef LOGGER_AUTOTUNE_MIN_QUEUE
+#define LOGGER_AUTOTUNE_MIN_QUEUE 4
+#endif
+#ifndef LOGGER_AUTOTUNE_MIN_BUF
+#define LOGGER_AUTOTUNE_MIN_BUF 64
+#endif
+/**
+ * Size of the encoding buffer a logger falls back to if its regular one cannot
+ * be allocated, see \ref mempress.h. MUST be at least 8. */
+#ifndef LOGGER_EMERG_BUF_SIZE
+#define LOGGER_EMERG_BUF_SIZE 64
+#endif
+/**
+ * Seconds the memory pressure signal stays high after an allocation failure,
+ * see \ref mempress_high() */
+#ifndef MEMPRESS_HOLD
+#define MEMPRESS_HOLD 30
+#endif
+/**
+ * Default number of record names a filter keeps track of, see \ref
+ * recfilt_init_t::names_max. MUST be power of 2. */
+#ifndef RECFILT_NAMES_MAX
+#define RECFILT_NAMES_MAX 8
+#endif
+/**
+ * Default number of record names an aggregator keeps track of, see \ref
+ * recaggr_init_t::names_max. MUST be power of 2. */
+#ifndef RECAGGR_NAMES_MAX
+#define RECAGGR_NAMES_MAX 8
+#endif
+/**
+ * Default number of record names a histogram stage keeps track of, see \ref
+ * rechist_init_t::names_max. MUST be power of 2. */
+#ifndef RECHIST_NAMES_MAX
+#define RECHIST_NAMES_MAX 4
+#endif
+/**
+ * Maximum number of buckets of a histogram stage, bounds the size of its
+ * records. */
+#ifndef RECHIST_BUCKETS_MAX
+#define RECHIST_BUCKETS_MAX 32
+#endif
+/**
+ * Tolerated deviation, in microseconds, of the interval between the records
+ * of a run from the run's spacing, see \ref RECSERF_RLE. The backend restores
+ * the timestamps of a run to within this, so anything but 0 trades timestamp
+ * precision for longer runs. */
+#ifndef RECSER_RLE_JITTER_US
+#define RECSER_RLE_JITTER_US 0
+#endif
+/**
+ * Number of record names with an open run at a time, see \ref RECSERF_RLE.
+ * Beyond, the run of the name queued the longest ago is closed. */
+#ifndef RECSER_RLE_NAMES
+#define RECSER_RLE_NAMES 8
+#endif
+/**
+ * Maximum number of transfer drivers of a logger, see \ref logg_add_driver() */
+#ifndef LOGGER_DRIVERS_MAX
+#define LOGGER_DRIVERS_MAX 2
+#endif
+/**
+ * Number of pool files per LTB instance whose time range is kept in RAM, to
+ * skip them in queries, see \ref ltb_query() */
+#ifndef LTB_INDEX_LEN
+#define LTB_INDEX_LEN 16
+#endif
+/**
+ * Priority of the sampler scheduler thread, see \ref sampler_create(). Above
+ * the main thread, so the samplings are on time. */
+#ifndef SAMPLER_PRIO
+#define SAMPLER_PRIO (THREAD_PRIORITY_MAIN - 1)
+#endif
+/**
+ * Stack size of the sampler scheduler thread. The read callbacks of the
+ * channels run on it. */
+#ifndef SAMPLER_STACKSIZE
+#define SAMPLER_STACKSIZE THREAD_STACKSIZE_MAIN
+#endif
+/**
+ * Maximum number of different periods of a sampler instance, see \ref
+ * sampler_add() */
+#ifndef SAMPLER_GROUPS_MAX
+#define SAMPLER_GROUPS_MAX 2
+#endif
+/**
+ * Maximum number of records a sampler puts in one batch. The channels of a
+ * period beyond this are put in further batches with the same timestamp. */
+#ifndef SAMPLER_BATCH_MAX
+#define SAMPLER_BATCH_MAX 4
+#endif
+/**
+ * Maximum length of the encoded remote configuration, see \ref remconf_fetch().
+ * Larger configurations are refused. */
+#ifndef REMCONF_MAXLEN
+#define REMCONF_MAXLEN 64
+#endif
+
+/**
+ * CoAP option number the backend may attach to its responses to pace the
+ * clients. The value is the minimum interval, in seconds, between two transfers
+ * of a publisher. Defaults to an elective option number from the experimental
+ * range, so servers and proxies that don't know it will ignore it. */
+#ifndef CDF_COAP_OPT_PACING
+#define CDF_COAP_OPT_PACING 65000
+#endif
 
 #endif /* INC_CONDALF_CONFIG_H_ */
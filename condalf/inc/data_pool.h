@@ -27,9 +27,10 @@
  *
  * @param pooldir path to the pool directory
  * @param name path to the existing file
+ * @param fid set to the id of the file in the pool on success. May be NULL.
  *
  * @return 0 on success, negative error otherwise */
-int dpool_move_file(char const *pooldir, char const *name);
+int dpool_move_file(char const *pooldir, char const *name, uint32_t *fid);
 /**
  * @brief Retrieve the path to the oldest file in a pool.
  *
@@ -42,6 +43,30 @@ int dpool_move_file(char const *pooldir, char const *name);
  * @return 0 on success, -ENOSPC if the buffer is to small to hold the path,
  *  other negative error otherwise */
 int dpool_get_oldest_file(char const *pooldir, char *namebuf, size_t buflen);
+/**
+ * @brief Retrieve the path to the oldest file in a pool with an id greater or
+ *  equal to \p from, i.e. iterate over the pool from old to new.
+ *
+ * @pre the pool directory must exist and be closed
+ *
+ * @param pooldir path to the pool directory
+ * @param from lowest file id to consider
+ * @param namebuf buffer to hold the path to the file
+ * @param buflen length of the buffer
+ * @param fid set to the id of the file on success
+ *
+ * @return 0 on success, -ENOENT if there is no such file, -ENOSPC if the
+ *  buffer is to small to hold the path, other negative error otherwise */
+int dpool_get_next_file(char const *pooldir, uint32_t from, char *namebuf,
+                        size_t buflen, uint32_t *fid);
+/**
+ * @brief Get the id of a pool file from its path.
+ *
+ * @param name path to the pool file
+ * @param fid set to the id on success
+ *
+ * @return 0 on success, -EINVAL if \p name is not a pool file name */
+int dpool_file_id(char const *name, uint32_t *fid);
 /**
  * @brief Erase all the files in a pool.
  *
@@ -22,6 +22,20 @@
  * Example:
  *
  * #define DLOG_TIME (sntp_get_unix_usec() / US_PER_SEC)
+ *
+ * If the user also defines DLOG_MODULE to a name before inclusion, the levels
+ * of the file can be lowered and raised again at runtime, up to DLOG_LEVEL,
+ * with \ref dlog_set_level() or the "loglevel" shell command. The same goes for
+ * the remote diagnostics level of the file, up to RDLOG_LEVEL (see \ref
+ * rdlog.h). A disabled call then costs a load and a compare.
+ *
+ * Example:
+ *
+ * #define DLOG_MODULE "logger"
+ *
+ * With \ref DLOG_ASYNC set, the messages are formatted on the calling thread,
+ * but printed by a low priority thread, see \ref dlog_async_init(). So the
+ * logging doesn't stall the caller on the UART.
  */
 
 #ifndef INC_DLOG_H_
@@ -56,44 +70,155 @@
 #endif
 
 #include "debug.h"
+#include <stdint.h>
+
+/**
+ * Set to 1 to print the messages asynchronously. They are formatted into the
+ * slots of a static ring, see \ref slotring.h, which a thread of \ref
+ * DLOG_DRAIN_PRIO prints. Messages finding the ring full are dropped and
+ * reported as a count. Messages left in the ring on a crash are not printed. */
+#ifndef DLOG_ASYNC
+#define DLOG_ASYNC 0
+#endif
+/**
+ * Number of slots of the asynchronous output ring. MUST be power of 2. */
+#ifndef DLOG_RING_LEN
+#define DLOG_RING_LEN 16
+#endif
+/**
+ * Size of a slot of the asynchronous output ring. Longer messages are
+ * truncated. */
+#ifndef DLOG_LINE_MAXLEN
+#define DLOG_LINE_MAXLEN 96
+#endif
+/**
+ * Priority of the asynchronous output thread. Just above idle, so the output
+ * takes only the time nothing else needs. */
+#ifndef DLOG_DRAIN_PRIO
+#define DLOG_DRAIN_PRIO (THREAD_PRIORITY_IDLE - 1)
+#endif
+/**
+ * Stack size of the asynchronous output thread. */
+#ifndef DLOG_DRAIN_STACKSIZE
+#define DLOG_DRAIN_STACKSIZE THREAD_STACKSIZE_DEFAULT
+#endif
+
+#define DLOGF_LOCAL  0x1 /**< the local level, see \ref dlog_set_level() */
+#define DLOGF_REMOTE 0x2 /**< the remote diagnostics level */
+
+/**
+ * Runtime levels of a module, see DLOG_MODULE */
+typedef struct dlog_mod {
+    char const *name;
+    volatile uint8_t level;         /**< local level */
+    volatile uint8_t rlevel;        /**< remote diagnostics level */
+    uint8_t const max_level;        /**< DLOG_LEVEL of the module */
+    uint8_t const max_rlevel;       /**< RDLOG_LEVEL of the module */
+} dlog_mod_t;
+
+/**
+ * @brief Set the runtime level of the modules. Levels above the ones the
+ *  module was compiled with are capped.
+ *
+ * @param name name of the module, see DLOG_MODULE. NULL for all the modules.
+ * @param level DLOG_* level, 0 to disable the logging
+ * @param flags \ref DLOGF_LOCAL and/or \ref DLOGF_REMOTE, the levels to set
+ *
+ * @return the number of modules set, -ENOENT if there is no such module */
+int dlog_set_level(char const *name, unsigned level, int flags);
+/**
+ * @brief Get a module by index, to list them.
+ *
+ * @param idx index, from 0 on
+ *
+ * @return the module, NULL if \p idx is past the last one */
+dlog_mod_t const *dlog_get_module(unsigned idx);
+/**
+ * @brief Start the asynchronous output thread, see \ref DLOG_ASYNC. The
+ *  messages logged before are kept in the ring until then.
+ *
+ * @return 0 on success, negative error otherwise */
+int dlog_async_init(void);
+/**
+ * @brief Format a message into the asynchronous output ring. Used by the
+ *  logging macros with \ref DLOG_ASYNC set. Any thread, never blocks.
+ *
+ * @param fmt printf-like format string */
+void dlog_printf(char const *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#ifdef DLOG_MODULE
+#include "xfa.h"
+#ifdef RDLOG_LEVEL
+#define _DLOG_RLEVEL RDLOG_LEVEL
+#else
+#define _DLOG_RLEVEL 0
+#endif
+/* The runtime levels of this file, collected in the module table */
+static XFA(dlog_mods, 0) dlog_mod_t _dlog_mod = {
+    .name       = DLOG_MODULE,
+    .level      = DLOG_LEVEL,
+    .rlevel     = _DLOG_RLEVEL,
+    .max_level  = DLOG_LEVEL,
+    .max_rlevel = _DLOG_RLEVEL
+};
+#define DLOG_ON(lvl)  ((lvl) <= _dlog_mod.level)
+#define RDLOG_ON(lvl) ((lvl) <= _dlog_mod.rlevel)
+#else
+#define DLOG_ON(lvl)  1
+#define RDLOG_ON(lvl) 1
+#endif
+
+#if DLOG_ASYNC == 1
+#define _DLOG_PRINT(...) dlog_printf(__VA_ARGS__)
+#else
+#define _DLOG_PRINT(...) DEBUG(__VA_ARGS__)
+#endif
 
 #ifdef DLOG_TIME
-#define DLOG(level, fmt, ...) DEBUG(level" %u %s: "fmt, (unsigned)(DLOG_TIME), __func__, ##__VA_ARGS__)
+#define DLOG(level, fmt, ...) _DLOG_PRINT(level" %u %s: "fmt, (unsigned)(DLOG_TIME), __func__, ##__VA_ARGS__)
 #else
-#define DLOG(level, fmt, ...) DEBUG(level" %s: "fmt, __func__, ##__VA_ARGS__)
+#define DLOG(level, fmt, ...) _DLOG_PRINT(level" %s: "fmt, __func__, ##__VA_ARGS__)
 #endif
 
 /**
  * Debug logging
  */
 #if (DLOG_LEVEL >= DLOG_DBG)
-#define DDBG(fmt, ...) DLOG(COLOR_BLU"DBG"COLOR_NRM, fmt, ##__VA_ARGS__)
+#define DDBG(fmt, ...) do { \
+    if (DLOG_ON(DLOG_DBG)) DLOG(COLOR_BLU"DBG"COLOR_NRM, fmt, ##__VA_ARGS__); \
+} while (0)
 #else
-#define DDBG(...)
+#define DDBG(...) do { } while (0)
 #endif
 /**
  * Info logging
  */
 #if (DLOG_LEVEL >= DLOG_INF)
-#define DINF(fmt, ...) DLOG("INF", fmt, ##__VA_ARGS__)
+#define DINF(fmt, ...) do { \
+    if (DLOG_ON(DLOG_INF)) DLOG("INF", fmt, ##__VA_ARGS__); \
+} while (0)
 #else
-#define DINF(...)
+#define DINF(...) do { } while (0)
 #endif
 /**
  * Error logging
  */
 #if (DLOG_LEVEL >= DLOG_WRN)
-#define DWRN(fmt, ...) DLOG(COLOR_YEL"WRN"COLOR_NRM, fmt, ##__VA_ARGS__)
+#define DWRN(fmt, ...) do { \
+    if (DLOG_ON(DLOG_WRN)) DLOG(COLOR_YEL"WRN"COLOR_NRM, fmt, ##__VA_ARGS__); \
+} while (0)
 #else
-#define DWRN(...)
+#define DWRN(...) do { } while (0)
 #endif
 /**
  * Error logging
  */
 #if (DLOG_LEVEL >= DLOG_ERR)
-#define DERR(fmt, ...) DLOG(COLOR_RED"ERR"COLOR_NRM, fmt, ##__VA_ARGS__)
+#define DERR(fmt, ...) do { \
+    if (DLOG_ON(DLOG_ERR)) DLOG(COLOR_RED"ERR"COLOR_NRM, fmt, ##__VA_ARGS__); \
+} while (0)
 #else
-#define DERR(...)
+#define DERR(...) do { } while (0)
 #endif
 
 #endif /* INC_DLOG_H_ */
@@ -10,7 +10,13 @@
  * @file
  * @brief ConDaLF logger
  *
- * The logger is thread-safe and does not block on IO. */
+ * The logger is thread-safe and does not block on IO.
+ *
+ * If an encoding buffer cannot be allocated, the logger raises the memory
+ * pressure signal (see \ref mempress.h) and falls back to a buffer of \ref
+ * LOGGER_EMERG_BUF_SIZE Bytes. Without even that, the records stay queued, and
+ * once the queue is full, the oldest one is dropped to make room for the new
+ * one. Urgent records are only dropped in favour of other urgent records. */
 
 #ifndef INC_LOGGING_H_
 #define INC_LOGGING_H_
@@ -18,6 +24,25 @@
 #include "transfer_driv.h"
 #include "recstr.h"
 #include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The encoded packs are passed to the transfer driver as \ref
+ * TRANSJOBF_UNRELIABLE jobs. Useful for high-rate or diagnostics data where
+ * occasional loss is acceptable. */
+#define LOGGERF_UNRELIABLE 0x1
+/**
+ * The logger measures the records per pack and the bytes per record of the
+ * packs cut by the put calls, and every \ref LOGGER_AUTOTUNE_PACKS packs resizes
+ * its record queue and encoding buffer to hit \ref logg_init_t::target_fill
+ * within \ref logg_init_t::ram_budget. The initial sizes are only the starting
+ * point. The chosen sizes are reported by \ref logg_get_stats(). */
+#define LOGGERF_AUTOTUNE   0x2
+/**
+ * Runs of records with the same value are encoded as a single record, see
+ * \ref RECSERF_RLE. Requires a backend that understands \ref SENML_LABEL_RC.
+ * Lossless, unless \ref RECSER_RLE_JITTER_US is raised. */
+#define LOGGERF_RLE        0x4
 
 typedef struct logg_init {
     /**
@@ -30,14 +55,16 @@ typedef struct logg_init {
     /**
      * The size of the queue that buffers the records before being encoded and
      * flushed. The memory footprint a logger instance requires is thus roughly
-     * proportional to this number. The current size of a record is 18 Bytes.
+     * proportional to this number. The current size of a record is 20 Bytes on
+     * 32-Bit systems.
      *
      * Depending on the encoder implementation, large buffering could mean
      * better compression (not yet the case).
      *
      * The size of the queue should also be weighed against the size
      * of the encoding buffer (see \ref encoding_buf_size ), e.g. a large queue
-     * size with small encoding buffer doesn't make sense.
+     * size with small encoding buffer doesn't make sense. \ref LOGGERF_AUTOTUNE
+     * lets the logger find the balance at runtime.
      *
      * @note !!! MUST be power of 2 !!!
      *
@@ -69,7 +96,58 @@ typedef struct logg_init {
      * "light", the resolved name at decoding will be "swp:cdf1:light". Thus,
      * data traffic can be reduced, as the prefix must be sent only once. */
     char  const *base_name;
+    /**
+     * Maximum time in seconds a record may wait in the logger before the
+     * pending records are flushed, even if the pack isn't full. Bounds the
+     * latency of low-rate streams, and what is lost on reset. 0 to flush only
+     * on full packs or explicit request. */
+    uint32_t max_latency;
+    /**
+     * Minimum number of pending records for the flush on \ref max_latency
+     * expiry. With fewer records, the flush is postponed by another
+     * \ref max_latency, to avoid lots of tiny packs. 0 or 1 to always flush.
+     *
+     * @note a stream that never reaches this many records within the pack
+     *  only gets flushed when the pack is full or on explicit request. */
+    size_t min_fill;
+    /**
+     * With \ref LOGGERF_AUTOTUNE, the RAM in Bytes the record queue and the
+     * encoding buffer may take together. The string copies owned by queued
+     * records are not accounted. 0 to use the initial footprint, i.e.
+     * \ref record_queue_size * sizeof(record_t) + \ref encoding_buf_size. */
+    size_t ram_budget;
+    /**
+     * With \ref LOGGERF_AUTOTUNE, the targeted fill ratio of the packs, in
+     * percent of the encoding buffer. 0 for \ref LOGGER_AUTOTUNE_TARGET_FILL. */
+    unsigned target_fill;
 } logg_init_t;
+/** Statistics of a logger, see \ref logg_get_stats() */
+typedef struct logg_stats {
+    uint32_t nb_packs;          /**< packs sent, whatever cut them */
+    uint32_t nb_records;        /**< records in these packs */
+    uint32_t nb_bytes;          /**< encoded Bytes in these packs */
+    uint32_t pack_interval;     /**< average seconds between two packs */
+    uint32_t nb_dropped;        /**< records dropped for lack of memory */
+    size_t record_queue_size;   /**< current record queue size */
+    size_t encoding_buf_size;   /**< current encoding buffer size */
+} logg_stats_t;
+/** Arguments for the creation of a logger substream */
+typedef struct logg_substream_init {
+    /**
+     * Name of the substream, will be copied internally. */
+    char const *name;
+    /**
+     * Base name of the substream records, see \ref logg_init_t::base_name.
+     * Will be copied internally. */
+    char const *base_name;
+    /**
+     * Maximum number of records of the substream in the queue of the logger.
+     * Once reached, the pending pack is flushed, and if the records still don't
+     * fit, further records are refused with -ENOSPC. This keeps a chatty
+     * substream from crowding out the others. 0 for no limit. */
+    size_t quota;
+} logg_substream_init_t;
+
 /**
  * @brief Allocate and initialize a logger instance
  *
@@ -80,5 +158,65 @@ typedef struct logg_init {
  * @return 0 on success, negative error otherwise
  */
 int logg_create(logg_init_t const *init, recstr_t **log);
+/**
+ * @brief Create a substream of a logger.
+ *
+ * The records put in a substream are queued and encoded along with the ones of
+ * the logger and its other substreams, sharing its encoding buffer and packs,
+ * but with their own base name. This saves both RAM and packs compared to a
+ * separate logger instance per stream.
+ *
+ * @param log pointer to a logger instance
+ * @param init see \ref logg_substream_init_t
+ * @param sub set to the new substream on success
+ *
+ * @return 0 on success, -ENOSPC if the logger already has \ref
+ *  LOGGER_SUBSTREAMS_MAX substreams, other negative error otherwise
+ *
+ * @note The substreams MUST be closed before the logger. Closing a substream
+ *  flushes the logger. */
+int logg_substream_create(recstr_t *log, logg_substream_init_t const *init,
+                          recstr_t **sub);
+/**
+ * @brief Change the record queue size and the encoding buffer size of a logger
+ *  at runtime.
+ *
+ * The queued records are flushed to the transfer driver beforehand, so the
+ * sizes apply to the following packs.
+ *
+ * @param log pointer to a logger instance
+ * @param record_queue_size see \ref logg_init_t::record_queue_size
+ * @param encoding_buf_size see \ref logg_init_t::encoding_buf_size
+ *
+ * With \ref LOGGERF_AUTOTUNE, the new sizes also replace \ref
+ * logg_init_t::ram_budget, and the tuning starts over from them.
+ *
+ * @return 0 on success, negative error otherwise. On failure, the logger keeps
+ *  its previous sizes. */
+int logg_resize(recstr_t *log, size_t record_queue_size, size_t encoding_buf_size);
+/**
+ * @brief Bind an additional transfer driver to a logger.
+ *
+ * Every pack is then encoded once, and the same buffer is handed to all the
+ * drivers of the logger, e.g. to an LTB for storage and to a publisher for
+ * live data. The buffer is freed when the last of the transfers finishes.
+ *
+ * @param log pointer to a logger instance
+ * @param driv pointer to an initialized transfer driver. MUST outlive the
+ *  logger.
+ * @param flags \ref LOGGERF_UNRELIABLE or 0, for the transfers of this driver.
+ *  The other flags are those of the logger.
+ *
+ * @return 0 on success, -ENOSPC if the logger already has \ref
+ *  LOGGER_DRIVERS_MAX drivers, other negative error otherwise */
+int logg_add_driver(recstr_t *log, transdrv_t *driv, int flags);
+/**
+ * @brief Get the statistics of a logger, including the sizes currently in use.
+ *
+ * @param log pointer to a logger instance
+ * @param stats filled with the statistics on success
+ *
+ * @return 0 on success, negative error otherwise */
+int logg_get_stats(recstr_t *log, logg_stats_t *stats);
 
 #endif /* INC_LOGGING_H_ */
@@ -23,7 +23,9 @@
 #if CONDALF_USE_LTB == 1
 
 #include "transfer_driv.h"
+#include "recstr.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #define LTB_NAME_LEN_MAX 8
@@ -64,6 +66,21 @@ typedef struct {
     char *name;
 } ltb_init_t;
 
+/** Arguments for a query, see \ref ltb_query() */
+typedef struct {
+    /**
+     * Records older than this, in seconds of their timestamps, are skipped */
+    uint32_t t_from;
+    /**
+     * Records as old or newer than this are skipped. 0 for no upper bound. */
+    uint32_t t_to;
+    /**
+     * Only records with this name, including the base name (e.g.
+     * "swp:cdf1:light"), are returned. NULL for all. Will be copied
+     * internally. */
+    char const *name;
+} ltb_query_t;
+
 /**
  * Init the LTB subsystem.
  *
@@ -74,6 +91,10 @@ int ltb_subsys_init(ltb_subsys_init_t const *init);
 /**
  * Create a LTB instance.
  *
+ * Jobs with \ref TRANSJOBF_URGENT set are sent directly by the sender of the
+ * instance, bypassing the pool. If this fails (or the instance has no sender),
+ * they are stored like the others.
+ *
  * @param drvpp pointer to a pointer to a LTB instance, that will be set to the
  *  newly created instance on success.
  *
@@ -83,6 +104,16 @@ int ltb_subsys_init(ltb_subsys_init_t const *init);
  *
  * @pre The subsystem was initialized with \ref ltb_subsys_init */
 int ltb_create(transdrv_t **drvpp, ltb_init_t const *init);
+/**
+ * Change the publishing threshold of the subsystem at runtime.
+ *
+ * @param nb_files_lim see \ref ltb_subsys_init_t::nb_files_lim
+ *
+ * @return 0 if the request was successfully enqueued, negative error otherwise
+ *
+ * @note The new limit is applied asynchronously. If it is already met, a
+ *  publishing session is started. */
+int ltb_set_nb_files_lim(size_t nb_files_lim);
 /**
  * Force the publishing of files, no matter the conditions.
  *
@@ -95,6 +126,28 @@ int ltb_create(transdrv_t **drvpp, ltb_init_t const *init);
  * @note this function does not block, so a success return value does not
  * necessarily mean the files were successfully published. */
 int ltb_force_publish(void (*cb)(int res));
+/**
+ * Read back the records stored in the pool of a LTB instance.
+ *
+ * The returned stream yields the matching records with \ref recstr_get(), from
+ * the oldest to the newest file, and -ENODATA once the pool is exhausted. Only
+ * the files that may hold matching records are read: the time range of the
+ * last \ref LTB_INDEX_LEN files stored since boot, as given by their jobs (see
+ * \ref transfer_job_t::t_max), is kept in RAM. The files are
+ * read with the pool locked, so they can be published meanwhile; a published
+ * file is simply not returned anymore.
+ *
+ * @param drv pointer to a LTB instance
+ * @param query see \ref ltb_query_t
+ * @param rs set to the query stream on success. Close it with \ref
+ *  recstr_close(), before deleting the LTB instance.
+ *
+ * @return 0 on success, negative error otherwise
+ *
+ * @note The name of a returned record is only valid until the next \ref
+ *  recstr_get() on the stream. The data of string records is owned by the
+ *  caller. */
+int ltb_query(transdrv_t *drv, ltb_query_t const *query, recstr_t **rs);
 
 #endif /* CONDALF_USE_LTB == 1 */
 
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @file
+ * @brief ConDaLF memory pressure signal
+ *
+ * Whoever fails to allocate on the data path raises the signal. It stays high
+ * for \ref MEMPRESS_HOLD seconds after the last raise, during which the modules
+ * shed optional work to leave the heap to the data: RDLOG doesn't send its info
+ * and debug records, the publisher doesn't merge packs and autotuning loggers
+ * keep their sizes.
+ *
+ * The functions are lock-free and may be called from interrupt context. */
+
+#ifndef INC_MEMPRESS_H_
+#define INC_MEMPRESS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Signal that an allocation failed. */
+void mempress_raise(void);
+/**
+ * @brief Check the memory pressure signal.
+ *
+ * @return true if the signal was raised within the last \ref MEMPRESS_HOLD
+ *  seconds */
+bool mempress_high(void);
+/**
+ * @brief Number of times the signal was raised since boot.
+ *
+ * @return number of raises */
+uint32_t mempress_count(void);
+
+#endif /* INC_MEMPRESS_H_ */
@@ -19,37 +19,113 @@
 #include "remote_res.h"
 #include <stdint.h>
 
+#if CONDALF_USE_DTLS == 1
+#include "net/credman.h"
+#endif
 
 typedef struct net_subsys_init {
     /* Parameters for the global net subsys */
     int dummy;
+#if CONDALF_USE_DTLS == 1
+    /**
+     * Credential used to secure the transfers with DTLS, e.g. a PSK known to
+     * the backend. Will be copied internally. */
+    credman_credential_t const *dtls_cred;
+#endif
 } net_subsys_init_t;
 
+#if CONDALF_USE_DTLS == 1
+/**
+ * DTLS handshake statistics. A handshake is counted when the DTLS sock reports
+ * its session ready, and timed from the start of the oldest request to the same
+ * server. The sock reports it only with the tinydtls sock and the sock_async
+ * module, otherwise the statistics stay 0. */
+typedef struct net_dtls_stats {
+    uint32_t nb_handshakes;     /**< # handshakes since boot */
+    uint32_t handshake_ms;      /**< cumulated handshake time, in ms */
+    uint32_t last_handshake_ms; /**< time of the last handshake, in ms */
+} net_dtls_stats_t;
+#endif
+/**
+ * Flow control hints the server attached to its responses. A field is 0 if the
+ * server did not send the respective hint. */
+typedef struct net_hint {
+    /**
+     * The server is overloaded and asked to hold off any further transfer for
+     * this many seconds (5.03 Service Unavailable or 4.29 Too Many Requests,
+     * with the retry time in the Max-Age option). */
+    uint32_t retry_after;
+    /**
+     * Minimum interval in seconds the server wishes between two transfers, as
+     * sent in the \ref CDF_COAP_OPT_PACING option. */
+    uint32_t min_interval;
+} net_hint_t;
+
 /**
  * @brief init the global state of the networking subsystem
  *
+ * With \ref CONDALF_USE_DTLS == 1, this MUST be called before the first
+ * transfer, in order to register the DTLS credential.
+ *
  * @param init parameters
  *
  * @return 0 on success, negative error otherwise
  */
 int net_subsys_init(net_subsys_init_t *init);
+#if CONDALF_USE_DTLS == 1
+/**
+ * @brief Retrieve the DTLS handshake statistics.
+ *
+ * The DTLS sessions are managed by gcoap, which keeps one session per server
+ * and reuses it for all the following transfers, until it is evicted to make
+ * room for another one (see CONFIG_DSM_PEER_MAX). A high handshake count
+ * relative to the number of transfers means sessions are evicted too early.
+ *
+ * The sessions live in RAM: they survive sleep modes that retain it, but not a
+ * reset or a deep sleep that powers it down. tinydtls has no abbreviated
+ * handshake, so a session lost this way takes a full handshake again.
+ *
+ * @param stats filled with the statistics */
+void net_dtls_get_stats(net_dtls_stats_t *stats);
+#endif
 /**
  * @brief Send data from a file descriptor to a CoAP resource.
  * The function blocks until the transfer is complete, or an error happens.
  *
  * @param res pointer to rem_res_t structure describing the CoAP ressource
  * @param fd VFS file descriptor to read from
+ * @param hint if not NULL, filled with the flow control hints of the server
+ *  responses. Valid on both success and failure.
  *
- * @return 0 on success, negative error otherwise */
-int net_send(rem_res_t const *res, int fd);
+ * @return 0 on success, -EBUSY if the server refused the transfer because it
+ *  is overloaded (see \ref net_hint_t::retry_after), other negative error
+ *  otherwise */
+int net_send(rem_res_t const *res, int fd, net_hint_t *hint);
+/**
+ * @brief Send data from a file descriptor to a CoAP resource as a single
+ * non-confirmable request. The function returns as soon as the request is
+ * handed to the network stack, without waiting for a response.
+ *
+ * @param res pointer to rem_res_t structure describing the CoAP ressource
+ * @param fd VFS file descriptor to read from
+ *
+ * @return 0 on success, -EMSGSIZE if the data does not fit in a single
+ *  datagram on the link towards the remote, other negative error otherwise */
+int net_send_unreliable(rem_res_t const *res, int fd);
 /**
  * @brief Receive data from a CoAP ressource into a file descriptor.
  * The function blocks until the transfer is complete, or an error happens.
  *
+ * The resource is requested with GET in \ref CDF_BLOCK_SIZE_EXP sized blocks
+ * (Block2, RFC 7959), every block being written to \p fd as soon as it is
+ * received. The server may choose smaller blocks.
+ *
  * @param res pointer to rem_res_t structure describing the CoAP ressource
- * @param fd VFS file descriptor to write to
+ * @param fd VFS file descriptor to write to, at its current position
  *
- * @return 0 on success, negative error otherwise */
+ * @return 0 on success, -ENOSPC if \p fd cannot take all the data, -EBUSY if
+ *  the server is overloaded, other negative error otherwise. On error, \p fd
+ *  may contain the blocks received so far. */
 int net_recv(rem_res_t const *res, int fd);
 
 #endif /* CONDALF_USE_PUBLISHER == 1 */
@@ -20,7 +20,93 @@
 
 #include "transfer_driv.h"
 #include "remote_res.h"
+#include <stddef.h>
+#include <stdint.h>
 
+/**
+ * Send every job as if it had \ref TRANSJOBF_UNRELIABLE set. */
+#define PUBLF_UNRELIABLE 0x1
+
+/** Arguments for the creation of a publisher instance */
+typedef struct {
+    /**
+     * Pointer to the remote CoAP resource. Will be copied internally. */
+    rem_res_t const *rem_res;
+    /**
+     * How many times to retry on sending failure. Values of 0 - 3 should
+     * suffice, as this may have impact on responsiveness. Not applicable to
+     * unreliable transfers. */
+    unsigned retry_cnt;
+    /**
+     * Flags, value of PUBLF_* */
+    int flags;
+    /**
+     * Depth of the queue for asynchronous jobs of this instance. If 0, \ref
+     * PUBLISHER_QUEUE_LEN is used. */
+    size_t queue_len;
+    /**
+     * How many transfers may be executed concurrently for the server endpoint
+     * (address and port) of this instance. The limit is shared by all the
+     * instances sending to the same endpoint, the largest one of them applies.
+     * Synchronous transfers count against it and wait for a free slot. If 0, 1
+     * is used.
+     *
+     * @note the concurrency of the asynchronous jobs is bound by \ref
+     *  PUBLISHER_NB_WORKERS */
+    unsigned max_inflight;
+    /**
+     * If not 0, queued jobs are merged into a single SenML pack of at most
+     * this many bytes, sent in a single transfer. The completion status of
+     * the transfer is reported to every merged job. Only jobs with the same
+     * flags are merged, at most \ref PUBLISHER_COALESCE_JOBS_MAX at once.
+     *
+     * @pre the jobs carry SenML packs encoded by \ref senml_enc_t */
+    size_t coalesce_len;
+} publ_init_t;
+
+/** Transfer statistics of a publisher instance */
+typedef struct {
+    /** Reliable transfers acknowledged by the server */
+    uint32_t nb_sent;
+    /** Reliable transfers that failed after all retries, including receive
+     *  transfers */
+    uint32_t nb_failed;
+    /** Unreliable transfers handed to the network, never acknowledged */
+    uint32_t nb_unacked;
+    /** Unreliable transfers too large for a single datagram. These were sent
+     *  reliably instead, and are also counted there. */
+    uint32_t nb_oversized;
+    /** Successful receive transfers */
+    uint32_t nb_received;
+} publ_stats_t;
+
+/**
+ * @brief Create a ConDaLF CoAP publisher instance
+ *
+ * Jobs with \ref TRANSJOBF_UNRELIABLE set (or all jobs, if \ref
+ * PUBLF_UNRELIABLE is set) are sent as a single non-confirmable request without
+ * waiting for a response, if they fit in a datagram on the link to the server.
+ * Otherwise, they are sent like any other job.
+ *
+ * Jobs with \ref TRANSJOBF_URGENT set are put in front of the queue, and are
+ * executed before the queued jobs of the other instances.
+ *
+ * Receive jobs download the remote resource into the job's file descriptor,
+ * starting at offset 0 (see \ref net_recv()). Asynchronous receive jobs share
+ * the queue with the send jobs.
+ *
+ * @param drvpp  pointer to a pointer to a transdrv_t. Will be set to the newly
+ *  created instance on success.
+ * @param init see \ref publ_init_t
+ *
+ * @note The publisher honours the flow control hints of the server (see \ref
+ * net_hint_t). Asynchronous transfers stay queued until the server accepts
+ * transfers again, without holding a sender thread, while synchronous ones fail
+ * with -EAGAIN instead of blocking the caller, also if the server refused the
+ * transfer with a hold-off; \ref transdrv_holdoff() tells when to try again.
+ *
+ * @return 0 on success, negative error otherwise */
+int publisher_create(transdrv_t **drvpp, publ_init_t const *init);
 /**
  * @brief Init a ConDaLF CoAP publisher instance
  *
@@ -33,8 +119,21 @@
  * @note \p retry_cnt may have impact on responsiveness. Values of 0 - 3 should
  * suffice.
  *
+ * @see \ref publisher_create()
+ *
  * @return 0 on success, negative error otherwise */
 int publisher_init(transdrv_t **drvpp, rem_res_t const *rem_res, unsigned retry_cnt);
+/**
+ * @brief Retrieve the transfer statistics of a publisher instance.
+ *
+ * @param drv pointer to the publisher instance
+ * @param stats filled with the statistics on success
+ *
+ * @return 0 on success, negative error otherwise
+ *
+ * @pre \p drv was created with \ref publisher_create() or \ref
+ *  publisher_init() */
+int publisher_get_stats(transdrv_t *drv, publ_stats_t *stats);
 
 #endif /* CONDALF_USE_PUBLISHER == 1 */
 
@@ -31,7 +31,10 @@
 
 #include "dlog.h"
 #include "transfer_driv.h"
+#include "recstr.h"
 #include "timex.h"
+#include <stdbool.h>
+#include <stdint.h>
 /**
  * Maximum length of a logged string.
  *
@@ -49,6 +52,101 @@
 #define RDLOG_REC_QUEUE_LEN 8
 #endif
 
+/**
+ * Number of slots of the static ring the messages are formatted into, each of
+ * \ref RDLOG_LOG_MAXLEN Bytes. A background thread drains the ring into the
+ * logger, so logging neither allocates nor blocks. Messages that find the ring
+ * full are dropped and counted.
+ *
+ * @note MUST be power of 2! */
+#ifndef RDLOG_RING_LEN
+#define RDLOG_RING_LEN 8
+#endif
+/**
+ * Priority of the thread draining the ring into the logger. Below the main
+ * thread by default, so that logging from the application threads doesn't
+ * preempt them. */
+#ifndef RDLOG_DRAIN_PRIO
+#define RDLOG_DRAIN_PRIO (THREAD_PRIORITY_MAIN + 1)
+#endif
+/**
+ * Stack size of the drain thread. */
+#ifndef RDLOG_DRAIN_STACKSIZE
+#define RDLOG_DRAIN_STACKSIZE THREAD_STACKSIZE_DEFAULT
+#endif
+/**
+ * Message queue length of the drain thread. MUST be power of 2. */
+#ifndef RDLOG_DRAIN_QUEUE_LEN
+#define RDLOG_DRAIN_QUEUE_LEN 4
+#endif
+
+/**
+ * Number of the last messages mirrored in RAM that survives a warm reset, e.g.
+ * after a fault or a reboot on purpose. On the first \ref RDLOG_enable() or
+ * \ref RDLOG_enable_aggr() after the reset, the mirrored messages that are
+ * intact are put into the logger again, with their original timestamps. So the
+ * diagnostics leading to the reset are not lost with the queued ones.
+ *
+ * Messages that were sent before the reset are sent again; backends keyed by
+ * name and time, e.g. InfluxDB, store them once. 0 to disable.
+ *
+ * @note Requires the linker to leave \ref RDLOG_NOINIT_ATTR uninitialized. */
+#ifndef RDLOG_NOINIT_LEN
+#define RDLOG_NOINIT_LEN 0
+#endif
+/**
+ * Attribute placing the mirror of \ref RDLOG_NOINIT_LEN in RAM that is not
+ * initialized at boot. */
+#ifndef RDLOG_NOINIT_ATTR
+#define RDLOG_NOINIT_ATTR __attribute__((section(".noinit")))
+#endif
+
+/**
+ * Flags of the internally used logger. Set to \ref LOGGERF_UNRELIABLE to
+ * have the diagnostics sent fire-and-forget, if the transfer driver supports it.
+ *
+ * @see \ref logg_init_t */
+#ifndef RDLOG_LOGGER_FLAGS
+#define RDLOG_LOGGER_FLAGS 0
+#endif
+
+/**
+ * Set to 1 to send the logs in binary form. Instead of the formatted text, a
+ * log record holds the format string's address followed by the raw arguments,
+ * as opaque data (\ref RECORDTYPE_DATA). The text is only rebuilt on the host,
+ * with the ELF file of the firmware:
+ *
+ *     tools/rdlog_decode.py firmware.elf < data_values
+ *
+ * This saves the formatting on the device, and most of the Bytes sent. The
+ * encoding of a log is bounded by \ref RDLOG_LOG_MAXLEN; the arguments that
+ * don't fit are left out, and long strings are cut.
+ *
+ * @note The logs can only be decoded with the ELF file of the very build that
+ *  sent them. */
+#ifndef RDLOG_BINARY
+#define RDLOG_BINARY 0
+#endif
+/**
+ * Number of messages a call site may send in a burst. Every \ref
+ * RDLOG_RATE_PERIOD seconds, the site may send one more, up to this. The
+ * messages beyond are suppressed, and counted: they are reported as a single
+ * "repeated N times: <format>" message in front of the next message of the site
+ * that passes, or on \ref RDLOG_flush(). The check is done before any
+ * formatting or allocation. 0 for no limit.
+ *
+ * @note The messages of a call site count as duplicates whatever their
+ *  arguments are. */
+#ifndef RDLOG_RATE_BURST
+#define RDLOG_RATE_BURST 4
+#endif
+/**
+ * Interval in seconds at which a call site regains a message, see \ref
+ * RDLOG_RATE_BURST. MUST not be 0. */
+#ifndef RDLOG_RATE_PERIOD
+#define RDLOG_RATE_PERIOD 300
+#endif
+
 #define RDLOG_ERR DLOG_ERR /**< Print error messages  */
 #define RDLOG_WRN DLOG_WRN /**< Print error, warning messages  */
 #define RDLOG_INF DLOG_INF /**< Print error, warning, info messages  */
@@ -65,7 +163,26 @@
 #endif
 
 #if CONDALF_USE_RDLOG == 1
-extern void _rdlog(unsigned level, char const *fmt, ...);
+/**
+ * Rate limiting state of a logging call site, see \ref RDLOG_RATE_BURST.
+ * Zero-initialized, one per call site. */
+typedef struct rdlog_site {
+    struct rdlog_site *next;    /**< in the list of sites with suppressed messages */
+    char const *fmt;            /**< format of the suppressed messages */
+    uint32_t last;              /**< ZTIMER_SEC time of the last refill */
+    uint16_t suppressed;        /**< number of suppressed messages */
+    uint8_t spent;              /**< messages sent out of the burst */
+    uint8_t level;              /**< level of the suppressed messages */
+    bool listed;                /**< in the list of sites with suppressed messages */
+} rdlog_site_t;
+
+extern void _rdlog(rdlog_site_t *site, unsigned level, char const *fmt, ...);
+#define _RDLOG(level, fmt, ...) do {                        \
+    static rdlog_site_t _rdlog_site;                        \
+    if (RDLOG_ON(level)) {                                  \
+        _rdlog(&_rdlog_site, level, fmt, ##__VA_ARGS__);    \
+    }                                                       \
+} while (0)
 /**
  * Enable the remote diagnostics. Can be called multiple times. If never called,
  * it will only print locally.
@@ -80,20 +197,35 @@ extern void _rdlog(unsigned level, char const *fmt, ...);
  * @return 0 on success, negative error otherwise */
 int RDLOG_enable(transdrv_t *transfer_driv, timex_t (*timef)(void), char const *base_name);
 /**
- * Flush the log buffer. */
+ * Enable the remote diagnostics, aggregated with the records of an existing
+ * logger. Instead of using its own logger, RDLOG puts its records in a
+ * substream of \p logger (see \ref logg_substream_create()), so they share its
+ * packs. The substream can hold at most \ref RDLOG_REC_QUEUE_LEN records in the
+ * queue of \p logger. \ref RDLOG_LOGGER_FLAGS does not apply.
+ *
+ * @param logger the logger to aggregate with. MUST outlive the remote
+ *  diagnostics, i.e. call \ref RDLOG_disable() before closing it.
+ * @param timef see \ref RDLOG_enable()
+ * @param base_name see \ref RDLOG_enable()
+ *
+ * @return 0 on success, negative error otherwise */
+int RDLOG_enable_aggr(recstr_t *logger, timex_t (*timef)(void), char const *base_name);
+/**
+ * Report the suppressed messages (see \ref RDLOG_RATE_BURST) and flush the log
+ * buffer. */
 void RDLOG_flush(void);
 /**
  * Disable the remote diagnostics. Further calls to log functions will only print
  * locally. */
 void RDLOG_disable(void);
 #else
-#define _rdlog(...)
+#define _RDLOG(...)
 #endif
 /**
  * Debug logging */
 #if (RDLOG_LEVEL >= RDLOG_DBG)
 #define RDDBG(fmt, ...) do {                \
-    _rdlog(RDLOG_DBG, fmt, ##__VA_ARGS__);  \
+    _RDLOG(RDLOG_DBG, fmt, ##__VA_ARGS__);  \
     DDBG(fmt"\n", ##__VA_ARGS__);           \
 } while (0)
 #else
@@ -103,7 +235,7 @@ void RDLOG_disable(void);
  * Info logging */
 #if (RDLOG_LEVEL >= RDLOG_INF)
 #define RDINF(fmt, ...) do {                \
-    _rdlog(RDLOG_INF, fmt, ##__VA_ARGS__);  \
+    _RDLOG(RDLOG_INF, fmt, ##__VA_ARGS__);  \
     DINF(fmt"\n", ##__VA_ARGS__);           \
 } while (0)
 #else
@@ -113,7 +245,7 @@ void RDLOG_disable(void);
  * Warning logging */
 #if (RDLOG_LEVEL >= RDLOG_WRN)
 #define RDWRN(fmt, ...) do {                \
-    _rdlog(RDLOG_WRN, fmt, ##__VA_ARGS__);  \
+    _RDLOG(RDLOG_WRN, fmt, ##__VA_ARGS__);  \
     DWRN(fmt"\n", ##__VA_ARGS__);           \
 } while (0)
 #else
@@ -123,7 +255,7 @@ void RDLOG_disable(void);
  * Error logging */
 #if (RDLOG_LEVEL >= RDLOG_ERR)
 #define RDERR(fmt, ...) do {                \
-    _rdlog(RDLOG_ERR, fmt, ##__VA_ARGS__);  \
+    _RDLOG(RDLOG_ERR, fmt, ##__VA_ARGS__);  \
     DERR(fmt"\n", ##__VA_ARGS__);           \
 } while (0)
 #else
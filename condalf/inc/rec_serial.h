@@ -16,6 +16,8 @@
 #include "record.h"
 #include "UsefulBuf.h"
 #include "senml_enc.h"
+#include "condalf_config.h"
+#include <stdbool.h>
 
 typedef struct peekcb {
     record_t *a;
@@ -24,6 +26,15 @@ typedef struct peekcb {
     size_t wi;
 } peekcb_t;
 
+/**
+ * Consecutive records of the same name, base, unit and numeric value, evenly
+ * spaced in time, are queued and encoded as a single record with a repeat count
+ * and the time of the last one, see \ref SENML_LABEL_RC. Records of other names
+ * in between don't break a run, up to \ref RECSER_RLE_NAMES names have one open
+ * at a time. The backend expands the run to the exact count and timestamps,
+ * unless \ref RECSER_RLE_JITTER_US is raised to tolerate uneven spacing. */
+#define RECSERF_RLE 0x1
+
 /** Record serializer parameters */
 typedef struct recser_init {
     /** Buffer for the encoding */
@@ -31,20 +42,40 @@ typedef struct recser_init {
     /** How many records to maximally encode in a buffer. MUST be power of 2.
      *  Note that the serializer will internally allocate
      *  len_limit * sizeof(record_t) bytes. The current size of record_t is
-     *  18 Bytes on 32-Bit systems. */
+     *  20 Bytes on 32-Bit systems. */
     size_t len_limit;
     /** Pointer to a base to be used for all the encodings. Leave NULL if not
      *  used. Copied internally, can be destroyed after \ref recser_init()
      *  returns. */
     record_base_t const *base;
+    /** Value of RECSERF_* */
+    int flags;
 } recser_init_t;
 
+/** Additional base of a serializer, see \ref recser_sub_add() */
+typedef struct recser_sub {
+    record_base_t base;
+    size_t quota;   /**< max. # queued records, 0 for no limit */
+    size_t cnt;     /**< # queued records */
+    bool used;
+    bool removed;   /**< freed as soon as no records are queued */
+} recser_sub_t;
+
 typedef struct recser {
     UsefulBuf buf;
     peekcb_t cb;
     senml_enc_t enc;
     size_t fit_cnt;
     record_base_t base;
+    recser_sub_t subs[LOGGER_SUBSTREAMS_MAX];
+    senml_rep_t *reps;  /**< run of each queue slot, with \ref RECSERF_RLE */
+    /** Queue position of the latest record of a name, i.e. its open run.
+     *  Positions no longer queued are unused. */
+    size_t runs[RECSER_RLE_NAMES];
+    /** Time range of the records in the buffer of the last \ref recser_swap(),
+     *  in seconds. t_max is 0 if it was empty. */
+    uint32_t t_min;
+    uint32_t t_max;
 } recser_t;
 
 /**
@@ -56,6 +87,59 @@ typedef struct recser {
  * @return 0 on success, -ENOSPC if the supplied buffer is too small, negative
  *  error otherwise */
 int recser_init(recser_t *rs, recser_init_t const *init);
+/**
+ * @brief Number of records queued in the serializer, including the ones
+ *  already encoded in the current buffer.
+ *
+ * @param rs pointer to the record serializer
+ *
+ * @return number of records */
+size_t recser_pending(recser_t const *rs);
+/**
+ * @brief Drop the oldest queued record, to make room under memory pressure.
+ *
+ * @param rs pointer to the record serializer
+ * @param keep_urgent if true, an oldest record with \ref RECORDF_URGENT is kept
+ *
+ * @return 0 on success, -ENODATA if the queue is empty, -EBUSY if the oldest
+ *  record is urgent and \p keep_urgent is set, other negative error otherwise */
+int recser_drop(recser_t *rs, bool keep_urgent);
+/**
+ * @brief Change the queue length and the encoding buffer of the serializer.
+ *
+ * @param rs pointer to the record serializer
+ * @param len_limit new queue length, see \ref recser_init_t::len_limit
+ * @param buf the new buffer for the encoding. On success, it will be filled
+ *  with the previous buffer, which is empty and can be freed.
+ *
+ * The queued records are kept. How many of them fit in the new buffer is
+ * simulated again, so the following \ref recser_put() reports a full buffer
+ * accordingly.
+ *
+ * @return 0 on success, -EBUSY if more records are queued than \p len_limit,
+ *  -ENOSPC if the supplied buffer is too small for the first queued record,
+ *  other negative error otherwise. On error, the serializer is unchanged. */
+int recser_resize(recser_t *rs, size_t len_limit, UsefulBuf *buf);
+/**
+ * @brief Add a base to the serializer. Records with \ref record_t::base set to
+ *  the returned index are encoded with this base, switching the base name
+ *  inside the pack as needed.
+ *
+ * @param rs pointer to the record serializer
+ * @param base the base. Copied internally.
+ * @param quota maximum number of queued records with this base, 0 for no limit
+ *
+ * @return index of the base (> 0) on success, -ENOSPC if \ref
+ *  LOGGER_SUBSTREAMS_MAX bases were already added, other negative error
+ *  otherwise */
+int recser_sub_add(recser_t *rs, record_base_t const *base, size_t quota);
+/**
+ * @brief Remove a base added with \ref recser_sub_add(). If records with this
+ *  base are still queued, the base is released once they are serialized.
+ *
+ * @param rs pointer to the record serializer
+ * @param idx index of the base */
+void recser_sub_remove(recser_t *rs, unsigned idx);
 /**
  * @brief Add a record to be serialized.
  *
@@ -66,8 +150,8 @@ int recser_init(recser_t *rs, recser_init_t const *init);
  *   0 on success
  *  -EAGAIN if the output buffer needs to be swapped. The record was
  *   nevertheless acknowledged and ownership was taken over its data.
- *  -ENOSPC if the record queue is full, and the serialized buffer must be
- *    swapped.
+ *  -ENOSPC if the record queue is full, or the records with the same base
+ *    reached their quota, and the serialized buffer must be swapped.
  *  -ENOBUFS if the supplied buffer is too small to be useful for any encoding.
  *    Call recser_swap with a bigger buffer.
  *  -EINVAL otherwise
@@ -85,6 +169,8 @@ int recser_put(recser_t *rs, record_t *rec);
  *  calls to this function or recser_put() will fail with EINVAL. On success
  *  (return value is 0 or -EAGAIN), this structure will be filled with the
  *  encoded buffer and the encoding length, otherwise will remain untouched.
+ *  The time range of its records is set in \ref recser_t::t_min and \ref
+ *  recser_t::t_max.
  *
  * @return 0 on success, -EAGAIN if there are unflushed buffered records, other
  *  negative error otherwise
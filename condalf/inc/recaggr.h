@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @file
+ * @brief ConDaLF record aggregator, windowed statistics stage
+ *
+ * A record stream that wraps another one, e.g. a logger. Instead of passing the
+ * numeric records on, it keeps per record name the minimum, maximum, sum and
+ * count over tumbling windows of \ref recaggr_init_t::window seconds, aligned
+ * to the record timestamps. When a window ends (see \ref recwin.h), its
+ * summary is passed on as four records named "<name>:min",
+ * "<name>:max", "<name>:mean" and "<name>:count", time-stamped with the start
+ * of the window.
+ *
+ * See \ref recwin.h for the records that are passed on as they are. */
+
+#ifndef INC_RECAGGR_H_
+#define INC_RECAGGR_H_
+
+#include "recstr.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct recaggr_init {
+    /**
+     * The stream the summaries are passed on to. Is flushed, but not closed
+     * along with the aggregator. */
+    recstr_t *next;
+    /**
+     * Name of the aggregator instance, will be copied internally. */
+    char const *name;
+    /**
+     * Window length in seconds of the record timestamps. MUST not be 0. */
+    uint32_t window;
+    /**
+     * Number of record names to keep track of. MUST be power of 2. 0 for
+     * \ref RECAGGR_NAMES_MAX. */
+    size_t names_max;
+} recaggr_init_t;
+
+/**
+ * @brief Allocate and initialize an aggregator instance
+ *
+ * @param init pointer to init structure
+ * @param aggr set to the new instance on success
+ *
+ * @return 0 on success, negative error otherwise
+ *
+ * @note Closing the stage flushes \ref recaggr_init_t::next, see \ref
+ *  recwin.h. */
+int recaggr_create(recaggr_init_t const *init, recstr_t **aggr);
+
+#endif /* INC_RECAGGR_H_ */
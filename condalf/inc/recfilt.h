@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @file
+ * @brief ConDaLF record filter, report-by-exception stage
+ *
+ * A record stream that wraps another one, e.g. a logger. Per record name, a
+ * numeric record is only passed on if its value differs from the last one
+ * passed by more than a deadband, or if the heartbeat interval elapsed since.
+ * Slowly changing values are thus neither encoded, nor stored, nor sent.
+ *
+ * Urgent records (\ref RECORDF_URGENT), string records and the records of
+ * names beyond \ref recfilt_init_t::names_max are always passed on. */
+
+#ifndef INC_RECFILT_H_
+#define INC_RECFILT_H_
+
+#include "recstr.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct recfilt_init {
+    /**
+     * The stream the records are passed on to. Is not closed along with the
+     * filter. */
+    recstr_t *next;
+    /**
+     * Name of the filter instance, will be copied internally. */
+    char const *name;
+    /**
+     * A record is passed on if its value differs from the last passed one by
+     * more than this, in units of the record. */
+    uint32_t abs_deadband;
+    /**
+     * A record is passed on if its value differs from the last passed one by
+     * more than this, in percent of the last passed value. If both deadbands
+     * are 0, any change is passed on. */
+    unsigned rel_deadband;
+    /**
+     * A record is passed on if the last passed one is older than this, in
+     * seconds of the record timestamps. 0 for no heartbeat. */
+    uint32_t heartbeat;
+    /**
+     * Number of record names to keep track of. MUST be power of 2. 0 for
+     * \ref RECFILT_NAMES_MAX. */
+    size_t names_max;
+} recfilt_init_t;
+
+/**
+ * @brief Allocate and initialize a filter instance
+ *
+ * @param init pointer to init structure
+ * @param filt set to the new instance on success
+ *
+ * @return 0 on success, negative error otherwise
+ *
+ * @note Putting NULL flushes \ref recfilt_init_t::next. A record that is
+ *  filtered out counts as a successful put. */
+int recfilt_create(recfilt_init_t const *init, recstr_t **filt);
+
+#endif /* INC_RECFILT_H_ */
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @file
+ * @brief ConDaLF record histogram stage
+ *
+ * A record stream that wraps another one, e.g. a logger. Instead of passing the
+ * numeric records on, it counts their values per record name in a histogram of
+ * fixed buckets (see \ref record_hist_t) over tumbling windows of \ref
+ * rechist_init_t::window seconds, aligned to the record timestamps. When a
+ * window ends (see \ref recwin.h), its histogram is passed on as a single
+ * record of type \ref RECORDTYPE_HIST named "<name>:hist", time-stamped with
+ * the start of the window.
+ *
+ * See \ref recwin.h for the records that are passed on as they are. */
+
+#ifndef INC_RECHIST_H_
+#define INC_RECHIST_H_
+
+#include "recstr.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct rechist_init {
+    /**
+     * The stream the histograms are passed on to. Is flushed, but not closed
+     * along with the histogram stage. */
+    recstr_t *next;
+    /**
+     * Name of the instance, will be copied internally. */
+    char const *name;
+    /**
+     * Window length in seconds of the record timestamps. MUST not be 0. */
+    uint32_t window;
+    /**
+     * Lower bound of the first bucket, see \ref record_hist_t::lo */
+    int32_t lo;
+    /**
+     * Width of the (first) bucket, see \ref record_hist_t::width. MUST not
+     * be 0. */
+    uint32_t width;
+    /**
+     * Number of buckets, at most \ref RECHIST_BUCKETS_MAX */
+    uint8_t nb_buckets;
+    /**
+     * Value of RECORD_HISTF_*, e.g. \ref RECORD_HISTF_LOG for latencies */
+    uint8_t flags;
+    /**
+     * Number of record names to keep track of. MUST be power of 2. 0 for
+     * \ref RECHIST_NAMES_MAX. */
+    size_t names_max;
+} rechist_init_t;
+
+/**
+ * @brief Allocate and initialize a histogram stage
+ *
+ * @param init pointer to init structure
+ * @param hist set to the new instance on success
+ *
+ * @return 0 on success, negative error otherwise
+ *
+ * @note Closing the stage flushes \ref rechist_init_t::next, see \ref
+ *  recwin.h. */
+int rechist_create(rechist_init_t const *init, recstr_t **hist);
+
+#endif /* INC_RECHIST_H_ */
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @file
+ * @brief ConDaLF record name map
+ *
+ * Maps record names to slot indices, for the record stream stages that keep
+ * state per name. The stage allocates its per-name state as an array of the
+ * same length as the map. The names are copied on insertion, as a record name
+ * is only valid until the stream is flushed, see \ref record_t::name. */
+
+#ifndef INC_RECNMAP_H_
+#define INC_RECNMAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct recnmap {
+    char **names;
+    size_t len;
+} recnmap_t;
+
+/**
+ * @brief Allocate the slots of a name map.
+ *
+ * @param map pointer to the map
+ * @param len number of slots. MUST be power of 2.
+ *
+ * @return 0 on success, negative error otherwise */
+int recnmap_init(recnmap_t *map, size_t len);
+/**
+ * @brief Release the slots of a name map.
+ *
+ * @param map pointer to the map */
+void recnmap_free(recnmap_t *map);
+/**
+ * @brief Find the slot of a name.
+ *
+ * @param map pointer to the map
+ * @param name the record name
+ * @param add if true, a free slot is assigned to an unknown name
+ *
+ * @return slot index on success, -ENOENT if the name is unknown and \p add is
+ *  false, -ENOSPC if all the slots are taken, -ENOMEM if the name could not be
+ *  copied */
+int recnmap_find(recnmap_t *map, char const *name, bool add);
+
+#endif /* INC_RECNMAP_H_ */
@@ -28,10 +28,17 @@ enum {
     RECORDTYPE_U32,    /**< RECORDTYPE_U32 */
     RECORDTYPE_I32,    /**< RECORDTYPE_I32 */
     RECORDTYPE_STRING, /**< RECORDTYPE_STRING */
+    RECORDTYPE_HIST,   /**< RECORDTYPE_HIST, see \ref record_hist_t */
+    RECORDTYPE_DATA,   /**< RECORDTYPE_DATA, see \ref record_data_t */
 
     RECORDTYPE_ENUMSIZE/**< RECORDTYPE_ENUMSIZE */
 };
 
+/**
+ * Record flags.
+ */
+#define RECORDF_URGENT 0x1 /**< must leave the device as soon as possible */
+
 /**
  * Record unit. Taken from SenML specification.
  */
@@ -99,6 +106,45 @@ enum {
     RECORDUNIT_ENUMSIZE     /**< RECORDUNIT_ENUMSIZE */
 };
 
+/**
+ * Histogram flags.
+ */
+#define RECORD_HISTF_LOG 0x1 /**< bucket widths double, see \ref record_hist_t */
+
+/**
+ * Histogram of a record of type \ref RECORDTYPE_HIST. Bucket i counts the
+ * values in [lo + i * width, lo + (i + 1) * width). With \ref RECORD_HISTF_LOG,
+ * bucket 0 covers [lo, lo + width) and bucket i > 0 covers
+ * [lo + 2^(i-1) * width, lo + 2^i * width). The first and last buckets also
+ * count the values below and above the range.
+ */
+typedef struct record_hist {
+    int32_t lo;         /**< lower bound of the first bucket */
+    uint32_t width;     /**< width of the (first) bucket */
+    uint32_t cnt;       /**< number of values */
+    int64_t sum;        /**< sum of the values */
+    uint8_t flags;      /**< Value of RECORD_HISTF_* */
+    uint8_t nb;         /**< number of buckets */
+    uint32_t buckets[]; /**< bucket counts */
+} record_hist_t;
+
+/**
+ * @brief Size of a histogram with \p nb buckets, for allocation. */
+#define RECORD_HIST_SIZE(nb) (sizeof(record_hist_t) + (nb) * sizeof(uint32_t))
+
+/**
+ * Opaque data of a record of type \ref RECORDTYPE_DATA, encoded as SenML data
+ * value (vd).
+ */
+typedef struct record_data {
+    uint16_t len;       /**< number of Bytes */
+    uint8_t bytes[];    /**< the data */
+} record_data_t;
+
+/**
+ * @brief Size of a data record holding \p len Bytes, for allocation. */
+#define RECORD_DATA_SIZE(len) (sizeof(record_data_t) + (len))
+
 typedef struct record {
     /** name is assumed to remain owned by the creator of the record, but allowed
      *  to be referenced more than once. Thus, it is the responsibility of the
@@ -123,10 +169,18 @@ typedef struct record {
          *  owner of the record must release this string with free() when the
          *  record is not used anymore. */
         char        *str;
+        /** Like \ref str, but allocated with \ref RECORD_HIST_SIZE() */
+        record_hist_t *hist;
+        /** Like \ref str, but allocated with \ref RECORD_DATA_SIZE() */
+        record_data_t *data;
     };
 
     uint8_t type; /**< Value of RECORDTYPE_* */
     uint8_t unit; /**< Value of RECORDUNIT_* */
+    /** Index of the base the record belongs to, see \ref recser_sub_add().
+     *  Set by the logger, leave 0 otherwise. */
+    uint8_t base;
+    uint8_t flags; /**< Value of RECORDF_* */
 } __attribute__((__packed__)) record_t;
 
 typedef struct {
@@ -139,6 +193,8 @@ static void record_move(record_t *to, record_t *from)
 {
     *to = *from;
     if (from->type == RECORDTYPE_STRING) from->str = NULL;
+    if (from->type == RECORDTYPE_HIST) from->hist = NULL;
+    if (from->type == RECORDTYPE_DATA) from->data = NULL;
 }
 
 static int record_copy(record_t *to, record_t const *from)
@@ -150,13 +206,39 @@ static int record_copy(record_t *to, record_t const *from)
         if (!to->str) return -ENOMEM;
     }
 
+    if (from->type == RECORDTYPE_HIST) {
+        size_t const size = RECORD_HIST_SIZE(from->hist->nb);
+        to->hist = malloc(size);
+        if (!to->hist) return -ENOMEM;
+        memcpy(to->hist, from->hist, size);
+    }
+
+    if (from->type == RECORDTYPE_DATA) {
+        size_t const size = RECORD_DATA_SIZE(from->data->len);
+        to->data = malloc(size);
+        if (!to->data) return -ENOMEM;
+        memcpy(to->data, from->data, size);
+    }
+
     return 0;
 }
 
 static void record_freedata(record_t *rec)
 {
-    if (rec->type == RECORDTYPE_STRING) free(rec->str);
-    rec->str = NULL;
+    if (rec->type == RECORDTYPE_STRING) {
+        free(rec->str);
+        rec->str = NULL;
+    }
+
+    if (rec->type == RECORDTYPE_HIST) {
+        free(rec->hist);
+        rec->hist = NULL;
+    }
+
+    if (rec->type == RECORDTYPE_DATA) {
+        free(rec->data);
+        rec->data = NULL;
+    }
 }
 
 static int record_base_copy(record_base_t *to, record_base_t const *from)
@@ -21,6 +21,7 @@
 #define RECORDSTREAM_MAX_STR_LEN 15
 
 typedef struct recstr recstr_t;
+typedef struct recstr_sub recstr_sub_t;
 
 typedef struct recstr_itf {
     int (*put)(recstr_t *, record_t *);
@@ -32,6 +33,27 @@ struct recstr {
     recstr_itf_t const *itf;
     mutex_t lock;
     char name[RECORDSTREAM_MAX_STR_LEN + 1];
+    recstr_sub_t *subs; /**< see \ref recstr_subscribe() */
+};
+
+/**
+ * Subscriber of a stream, allocated by the caller. */
+struct recstr_sub {
+    recstr_sub_t *next;
+    /**
+     * Only records of this name are passed to the subscriber, NULL for all.
+     * Referenced, not copied. */
+    char const *name;
+    /**
+     * Called with every matching record put in the stream, before the stream
+     * takes it over. The record, including its data, is only valid during the
+     * call; copy what is needed. Runs in the context of the putting thread,
+     * with the stream locked: keep it short, and don't put records in the same
+     * stream. */
+    void (*cb)(recstr_sub_t *sub, record_t const *rec);
+    /**
+     * Free for use by the subscriber */
+    void *arg;
 };
 
 /**
@@ -57,11 +79,60 @@ static int recstr_put(recstr_t *rs, record_t *rec)
     if (!rs->itf->put) return -ENOSYS;
 
     mutex_lock(&rs->lock);
+
+    if (rec) {
+        for (recstr_sub_t *sub = rs->subs; sub; sub = sub->next) {
+            if (sub->name && (!rec->name || strcmp(sub->name, rec->name))) continue;
+            sub->cb(sub, rec);
+        }
+    }
+
     int ret = rs->itf->put(rs, rec);
     mutex_unlock(&rs->lock);
 
     return ret;
 }
+/**
+ * @brief Append a batch of records to the stream. Thread safe.
+ *
+ * Same as calling \ref recstr_put() for every record, but the stream is only
+ * locked once, so the batch is not interleaved with the records of other
+ * threads.
+ *
+ * @param rs pointer to a recstr_t
+ * @param recs array of records, see \ref recstr_put()
+ * @param nb number of records in \p recs. MUST not be 0.
+ *
+ * @return the number of records taken over, counted from the first one. Less
+ *  than \p nb if a record was refused; the ownership over it and the following
+ *  ones remains with the caller. Negative error if the first one was refused.
+ */
+static int recstr_putv(recstr_t *rs, record_t *recs, size_t nb)
+{
+    if (!rs || !recs || !nb) return -EINVAL;
+    if (!rs->itf->put) return -ENOSYS;
+
+    int ret = 0;
+    size_t i;
+
+    mutex_lock(&rs->lock);
+
+    for (i = 0; i < nb; i++) {
+        record_t *rec = &recs[i];
+
+        for (recstr_sub_t *sub = rs->subs; sub; sub = sub->next) {
+            if (sub->name && (!rec->name || strcmp(sub->name, rec->name))) continue;
+            sub->cb(sub, rec);
+        }
+
+        ret = rs->itf->put(rs, rec);
+        if (ret) break;
+    }
+
+    mutex_unlock(&rs->lock);
+
+    return i ? (int)i : ret;
+}
 /**
  * @brief Retrieve a Record_t from a stream, blocking. Thread safe.
  *
@@ -82,6 +153,54 @@ static int recstr_get(recstr_t *rs, record_t *rec)
 
     return ret;
 }
+/**
+ * @brief Subscribe to the records put in a stream. Thread safe.
+ *
+ * The subscriber sees the records as they are passed to \ref recstr_put(),
+ * without copy, whether or not the stream accepts them afterwards.
+ *
+ * @param rs pointer to a recstr_t
+ * @param sub the subscriber, with \ref recstr_sub_t::cb set. MUST stay valid
+ *  until unsubscribed.
+ *
+ * @return 0 on success, negative error otherwise */
+static int recstr_subscribe(recstr_t *rs, recstr_sub_t *sub)
+{
+    if (!rs || !sub || !sub->cb) return -EINVAL;
+
+    mutex_lock(&rs->lock);
+    sub->next = rs->subs;
+    rs->subs = sub;
+    mutex_unlock(&rs->lock);
+
+    return 0;
+}
+/**
+ * @brief Remove a subscriber from a stream. Thread safe. MUST be called
+ *  before the stream is closed.
+ *
+ * @param rs pointer to a recstr_t
+ * @param sub the subscriber
+ *
+ * @return 0 on success, -ENOENT if \p sub is not subscribed to \p rs */
+static int recstr_unsubscribe(recstr_t *rs, recstr_sub_t *sub)
+{
+    if (!rs || !sub) return -EINVAL;
+
+    int ret = -ENOENT;
+
+    mutex_lock(&rs->lock);
+    for (recstr_sub_t **it = &rs->subs; *it; it = &(*it)->next) {
+        if (*it == sub) {
+            *it = sub->next;
+            ret = 0;
+            break;
+        }
+    }
+    mutex_unlock(&rs->lock);
+
+    return ret;
+}
 /**
  * @brief Close a stream. This will flush the stream (if applicable) and
  * deallocate any resources allocated with the stream.
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @file
+ * @brief ConDaLF record ring subscriber
+ *
+ * A stream subscriber (see \ref recstr_subscribe()) that keeps a copy of the
+ * last records in a bounded ring, for local consumers that poll, e.g. a
+ * display. If the ring is full, the new records are dropped and counted. */
+
+#ifndef INC_RECSUB_H_
+#define INC_RECSUB_H_
+
+#include "recstr.h"
+#include "mutex.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct recsub_ring {
+    recstr_sub_t sub;   /**< pass to \ref recstr_subscribe() */
+    record_t *a;
+    size_t len;
+    size_t ri;
+    size_t wi;
+    uint32_t dropped;   /**< records dropped because the ring was full */
+    mutex_t lock;
+} recsub_ring_t;
+
+/**
+ * @brief Initialize a ring subscriber
+ *
+ * @param ring pointer to the ring
+ * @param buf storage for the records
+ * @param len number of records in \p buf. MUST be power of 2.
+ * @param name see \ref recstr_sub_t::name
+ *
+ * @return 0 on success, negative error otherwise */
+int recsub_ring_init(recsub_ring_t *ring, record_t *buf, size_t len,
+                     char const *name);
+/**
+ * @brief Take the oldest record out of the ring. Thread safe, non-blocking.
+ *
+ * @param ring pointer to the ring
+ * @param rec filled with the record on success. Its data (see \ref record_t)
+ *  is then owned by the caller.
+ *
+ * @return 0 on success, -ENODATA if the ring is empty */
+int recsub_ring_get(recsub_ring_t *ring, record_t *rec);
+
+#endif /* INC_RECSUB_H_ */
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @file
+ * @brief ConDaLF tumbling windows per record name
+ *
+ * Common part of the record stream stages that summarize the numeric records
+ * of each name over tumbling windows of a fixed number of seconds, aligned to
+ * the record timestamps, e.g. \ref recaggr.h and \ref rechist.h. The stage
+ * embeds a \ref recwin_t as its first member and provides the per-sample
+ * update and the emission of a closed window by \ref recwin_ops_t.
+ *
+ * A window is passed on as soon as a record of any name is put with a
+ * timestamp past its end, so a name that goes quiet does not hold its last
+ * window until its next sample. Flushing the stage passes on the windows that
+ * ended before the latest timestamp seen. A sample older than the open window
+ * of its name is passed on as it is.
+ *
+ * String records, and the records of names beyond the tracked ones, are passed
+ * on as they are. Urgent records (\ref RECORDF_URGENT) are passed on as well
+ * as summarized. Closing the stage passes on the open windows and flushes the
+ * next stream, as the stage owns the names of the summaries. */
+
+#ifndef INC_RECWIN_H_
+#define INC_RECWIN_H_
+
+#include "recstr.h"
+#include "recnmap.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Header of the per-name window, first member of the stage's window type */
+typedef struct recwin_win {
+    uint32_t start;     /**< start of the window, in seconds */
+    uint32_t cnt;       /**< number of samples, 0 if the window is not open */
+    uint8_t unit;       /**< unit of the first sample */
+    uint8_t type;       /**< type of the first sample */
+    bool ready;         /**< the stage's per-name state is allocated */
+} recwin_win_t;
+
+typedef struct recwin recwin_t;
+
+typedef struct recwin_ops {
+    /**
+     * Allocate the per-name state on the first sample of \p name. */
+    int (*open)(recwin_t *rw, recwin_win_t *win, char const *name);
+    /**
+     * Add a sample. \ref recwin_win_t::cnt is 0 on the first sample of the
+     * window, and is counted after the call. */
+    void (*add)(recwin_t *rw, recwin_win_t *win, int64_t val);
+    /**
+     * Pass the summary of a closed window on to \ref recwin_t::next and reset
+     * the per-sample state. */
+    int (*emit)(recwin_t *rw, recwin_win_t *win);
+    /**
+     * Release the per-name state. */
+    void (*release)(recwin_win_t *win);
+} recwin_ops_t;
+
+struct recwin {
+    recstr_t stream;
+    recstr_t *next;
+    recwin_ops_t const *ops;
+    uint32_t window;
+    uint32_t oldest;    /**< start of the oldest open window */
+    uint32_t latest;    /**< start of the latest window seen */
+    recnmap_t names;
+    size_t win_size;
+    uint8_t *wins;      /**< names.len windows of win_size Bytes */
+};
+
+typedef struct recwin_init {
+    /**
+     * Stream interface of the stage. */
+    recstr_itf_t const *itf;
+    /**
+     * Stage specific part of the windows. */
+    recwin_ops_t const *ops;
+    /**
+     * Size of the stage's window type, starting with \ref recwin_win_t. */
+    size_t win_size;
+    /**
+     * The stream the summaries are passed on to. */
+    recstr_t *next;
+    /**
+     * Name of the stage instance, will be copied internally. */
+    char const *name;
+    /**
+     * Window length in seconds. MUST not be 0. */
+    uint32_t window;
+    /**
+     * Number of record names to keep track of. MUST be power of 2. */
+    size_t names_max;
+} recwin_init_t;
+
+/**
+ * @brief Initialize the windows of a stage.
+ *
+ * @param rw pointer to the zero-initialized stage
+ * @param init pointer to init structure
+ *
+ * @return 0 on success, negative error otherwise */
+int recwin_init(recwin_t *rw, recwin_init_t const *init);
+/**
+ * @brief Put a record into the windows, for \ref recstr_itf_t::put.
+ *
+ * @param rw pointer to the stage, locked
+ * @param rec the record, NULL passes on the ended windows and flushes
+ *  \ref recwin_t::next
+ *
+ * @return 0 on success, negative error otherwise */
+int recwin_put(recwin_t *rw, record_t *rec);
+/**
+ * @brief Pass the open windows on, flush \ref recwin_t::next and release the
+ *  windows. The stage itself is not freed.
+ *
+ * @param rw pointer to the stage
+ *
+ * @return 0 on success, negative error otherwise */
+int recwin_close(recwin_t *rw);
+
+#endif /* INC_RECWIN_H_ */
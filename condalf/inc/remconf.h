@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @file
+ * @brief ConDaLF remote configuration
+ *
+ * The backend serves the configuration of a site as a CBOR map with integer
+ * keys (REMCONF_KEY_*) and unsigned integer values, e.g. {1: 64, 3: 8}. The
+ * client fetches it with a receive transfer (e.g. from a publisher bound to the
+ * configuration resource) and applies the values it received. Unknown keys are
+ * ignored, so the backend may serve keys newer clients understand. */
+
+#ifndef INC_REMCONF_H_
+#define INC_REMCONF_H_
+
+#include "transfer_driv.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Configuration keys */
+enum {
+    REMCONF_KEY_LOGG_QUEUE_LEN = 1, /**< see \ref logg_init_t::record_queue_size */
+    REMCONF_KEY_LOGG_BUF_SIZE,      /**< see \ref logg_init_t::encoding_buf_size */
+    REMCONF_KEY_LTB_FILES_LIM,      /**< see \ref ltb_subsys_init_t::nb_files_lim */
+    REMCONF_KEY_SAMPLING_PERIOD,    /**< application sampling period, in seconds */
+    REMCONF_KEY_RDLOG_LEVEL,        /**< remote diagnostics level of all the
+                                         modules, see \ref dlog_set_level() */
+
+    REMCONF_KEY_NUMOF
+};
+
+/** Decoded configuration */
+typedef struct remconf {
+    /** Bit (1 << key) is set for every key received */
+    uint32_t mask;
+    /** Values, indexed by key. Only valid if the respective bit in \ref mask is
+     *  set. */
+    uint32_t val[REMCONF_KEY_NUMOF];
+} remconf_t;
+
+/**
+ * @brief Fetch and decode the configuration. Blocks until the transfer is
+ *  complete.
+ *
+ * @param drv transfer driver to receive the configuration with, e.g. a
+ *  publisher bound to the configuration resource
+ * @param conf filled with the configuration on success
+ *
+ * @return 0 on success, -EBADMSG if the configuration cannot be decoded, other
+ *  negative error otherwise */
+int remconf_fetch(transdrv_t *drv, remconf_t *conf);
+/**
+ * @brief Decode a configuration.
+ *
+ * @param buf CBOR-encoded configuration map
+ * @param len length of \p buf
+ * @param conf filled with the configuration on success
+ *
+ * @return 0 on success, -EBADMSG if \p buf is not a valid configuration */
+int remconf_decode(void const *buf, size_t len, remconf_t *conf);
+/**
+ * @brief Retrieve a configuration value.
+ *
+ * @param conf decoded configuration
+ * @param key REMCONF_KEY_*
+ * @param val set to the value, if present
+ *
+ * @return true if the configuration contains \p key, false otherwise */
+static bool remconf_get(remconf_t const *conf, unsigned key, uint32_t *val)
+{
+    if (!conf || key >= REMCONF_KEY_NUMOF) return false;
+    if (!(conf->mask & (1UL << key))) return false;
+
+    *val = conf->val[key];
+    return true;
+}
+
+#endif /* INC_REMCONF_H_ */
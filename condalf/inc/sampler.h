@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @file
+ * @brief ConDaLF periodic sampler
+ *
+ * Instead of a hand-rolled sleep loop per application, sensor channels are
+ * registered with a sampler instance, each with a period and a read callback.
+ * A common scheduler thread samples them on a drift-free schedule: the next
+ * sampling time is advanced by the period from the previous one, not from the
+ * time the previous sampling finished.
+ *
+ * The channels of an instance that share a period are sampled together. Their
+ * records get one common timestamp and are put into \ref
+ * sampler_init_t::next in a single batch (see \ref recstr_putv()).
+ *
+ * If a sampling runs late by more than a period, e.g. because of a slow read
+ * callback, the missed samplings are skipped rather than caught up. */
+
+#ifndef INC_SAMPLER_H_
+#define INC_SAMPLER_H_
+
+#include "recstr.h"
+#include "timex.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct sampler sampler_t;
+typedef struct sampler_chan sampler_chan_t;
+
+/**
+ * A sensor channel, allocated by the caller. */
+struct sampler_chan {
+    sampler_chan_t *next;
+    /**
+     * Name of the records, referenced, not copied. See \ref record_t::name */
+    char const *name;
+    /**
+     * Unit of the records, value of \ref RECORDUNIT_* */
+    uint8_t unit;
+    /**
+     * Sampling period in milliseconds. MUST not be 0. */
+    uint32_t period;
+    /**
+     * Reads the sensor. Called from the scheduler thread with a record whose
+     * name, unit and timestamp are already set; the callback sets the type
+     * and the value, and possibly \ref RECORDF_URGENT.
+     *
+     * @return 0 if the record is to be put, negative error to skip it */
+    int (*read)(sampler_chan_t *chan, record_t *rec);
+    /**
+     * Free for use by the callback */
+    void *arg;
+};
+
+typedef struct sampler_init {
+    /**
+     * The stream the records are put into, e.g. a logger or a filter. */
+    recstr_t *next;
+    /**
+     * Returns the timestamp of a sampling. If the returned \ref
+     * timex_t::seconds is 0, e.g. while the time is not set, the sampling is
+     * skipped. */
+    timex_t (*timef)(void);
+} sampler_init_t;
+
+/**
+ * @brief Allocate a sampler instance. The scheduler thread is started on the
+ *  first call.
+ *
+ * @param init pointer to init structure
+ * @param smp set to the new instance on success
+ *
+ * @return 0 on success, negative error otherwise */
+int sampler_create(sampler_init_t const *init, sampler_t **smp);
+/**
+ * @brief Register a channel. Thread safe. Its first sampling is one period
+ *  from now, along with the channels of the same period, if any.
+ *
+ * @param smp pointer to a sampler instance
+ * @param chan the channel, MUST stay valid until removed
+ *
+ * @return 0 on success, -ENOSPC if the instance already has \ref
+ *  SAMPLER_GROUPS_MAX different periods, other negative error otherwise */
+int sampler_add(sampler_t *smp, sampler_chan_t *chan);
+/**
+ * @brief Unregister a channel. Thread safe. Once returned, the read callback of
+ *  the channel is not called anymore.
+ *
+ * Waits for a sampling in progress to finish, so it MUST not be called from a
+ * read callback or the stream the records are put into.
+ *
+ * To change the period of a channel, remove it, change \ref
+ * sampler_chan_t::period and add it again.
+ *
+ * @param smp pointer to a sampler instance
+ * @param chan the channel
+ *
+ * @return 0 on success, -ENOENT if \p chan is not registered */
+int sampler_remove(sampler_t *smp, sampler_chan_t *chan);
+/**
+ * @brief Stop the sampling and free a sampler instance. The stream is neither
+ *  flushed nor closed. Like \ref sampler_remove, waits for a sampling in
+ *  progress to finish.
+ *
+ * @param smp pointer to the instance pointer. Set to NULL on return. */
+void sampler_delete(sampler_t **smp);
+
+#endif /* INC_SAMPLER_H_ */
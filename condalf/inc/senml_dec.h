@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @file
+ * @brief SenML CBOR decoder for the packs produced by \ref senml_enc.h
+ *
+ * Decodes the records of a pack one by one, resolving the base names and
+ * expanding the runs (see \ref SENML_LABEL_RC). Integer values are returned as
+ * \ref RECORDTYPE_I32 if they fit, \ref RECORDTYPE_U32 otherwise. Records
+ * without a numeric or string value, e.g. histograms, are skipped. */
+
+#ifndef INC_SENML_DEC_H_
+#define INC_SENML_DEC_H_
+
+#include "record.h"
+#include "qcbor.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/** Maximum length of a resolved record name, longer ones are truncated */
+#ifndef SENML_DEC_NAME_MAX
+#define SENML_DEC_NAME_MAX 47
+#endif
+
+typedef struct senml_dec {
+    QCBORDecodeContext ctx;
+    size_t left;                        /**< records left in the pack */
+    char bn[SENML_DEC_NAME_MAX + 1];
+    char name[SENML_DEC_NAME_MAX + 1];
+    /* Run being expanded */
+    record_t run;
+    uint32_t run_left;
+    uint64_t run_t;
+    uint64_t run_step;
+    uint64_t run_end;                   /**< time of the last record, rt_ */
+} senml_dec_t;
+
+/**
+ * @brief Init the decoder on an encoded pack.
+ *
+ * @param dec pointer to decoder
+ * @param buf the pack. MUST stay valid while decoding.
+ * @param len length of the pack
+ *
+ * @return 0 on success, -EBADMSG if \p buf is not a pack */
+int senml_dec_init(senml_dec_t *dec, void const *buf, size_t len);
+/**
+ * @brief Decode the next record of the pack.
+ *
+ * @param dec pointer to decoder
+ * @param rec filled with the record on success. Its name points into \p dec
+ *  and is valid until the next call. The data of string records is allocated
+ *  and owned by the caller.
+ *
+ * @return 0 on success, -ENODATA at the end of the pack, -EBADMSG if the pack
+ *  is malformed, -ENOMEM if a string cannot be allocated */
+int senml_dec_next(senml_dec_t *dec, record_t *rec);
+
+#endif /* INC_SENML_DEC_H_ */
@@ -10,6 +10,11 @@
  * @file
  * @brief Quick and easy SenML CBOR encoder for ConDaLF records. Does not support
  *  any compression yet.
+ *
+ * Records of type \ref RECORDTYPE_HIST are encoded with the sum of the values
+ * (s) and a data value (vd) holding the CBOR array
+ * [lo, width, flags, bucket counts...], see \ref record_hist_t. Records of
+ * type \ref RECORDTYPE_DATA are encoded with their Bytes as data value (vd).
  */
 
 #ifndef SRC_INC_SENML_ENC_H_
@@ -18,12 +23,42 @@
 #include "record.h"
 #include "qcbor.h"
 #include <stddef.h>
+#include <stdbool.h>
+
+/** Maximum length of the header of an encoded pack */
+#define SENML_PACK_HDR_MAXLEN 5
+/** Length of a record resetting the base name, see \ref senml_pack_bn_reset() */
+#define SENML_PACK_BN_RESET_LEN 3
+/**
+ * Extension label of a record standing for a run of records with the same
+ * value: the number of records in the run. The label ends with "_", so
+ * receivers that do not know it must reject the pack rather than silently
+ * lose records (RFC 8428, section 12.2). */
+#define SENML_LABEL_RC "rc_"
+/**
+ * Extension label: time of the last record of a run. The run's records are
+ * evenly spaced between the record time (t) and this one. */
+#define SENML_LABEL_RT "rt_"
+
+/** Run of records with the same value, see \ref senml_enc_put_rep() */
+typedef struct senml_rep {
+    uint32_t cnt;   /**< number of records in the run, 1 for no repetition */
+    timex_t last;   /**< timestamp of the last record of the run */
+} senml_rep_t;
 
 typedef struct senml_enc {
     UsefulBuf buf;
     QCBOREncodeContext cbor_ctx;
+    char const *bn; /**< base name currently in effect */
 } senml_enc_t;
 
+/**
+ * @brief Look up the record unit of a SenML unit string.
+ *
+ * @param unit the SenML unit, e.g. "Cel"
+ *
+ * @return value of RECORDUNIT_*, \ref RECORDUNIT_NONE if unknown */
+int senml_unit_parse(UsefulBufC unit);
 /**
  * @brief init SenML encoder
  *
@@ -52,6 +87,46 @@ int senml_enc_init(senml_enc_t *enc, char *buf, size_t size, record_base_t const
  *  this call will merely simulate if the record could have been added to the
  *  buffer of the specified size, without actually encoding anything. */
 int senml_enc_put(senml_enc_t *enc, record_t const *rec);
+/**
+ * Put a record with a given base name in the buffer. If \p bn differs from the
+ * base name currently in effect, the record carries the new base name, which
+ * then applies to the following records as well.
+ *
+ * @param enc pointer to encoder
+ * @param rec record to be added
+ * @param bn base name of the record. NULL for no base name.
+ *
+ * @return see \ref senml_enc_put() */
+int senml_enc_put_bn(senml_enc_t *enc, record_t const *rec, char const *bn);
+/**
+ * Put a record standing for a run of records with the same value, see
+ * \ref SENML_LABEL_RC and \ref SENML_LABEL_RT.
+ *
+ * @param enc pointer to encoder
+ * @param rec first record of the run
+ * @param bn see \ref senml_enc_put_bn()
+ * @param rep the run. NULL or a count of 1 to encode a single record.
+ *
+ * @return see \ref senml_enc_put() */
+int senml_enc_put_rep(senml_enc_t *enc, record_t const *rec, char const *bn,
+                      senml_rep_t const *rep);
+/**
+ * Encoded size of the run fields of a record, see \ref senml_enc_put_rep().
+ *
+ * @param rep the run
+ *
+ * @return size in bytes, 0 for a single record */
+size_t senml_enc_rep_len(senml_rep_t const *rep);
+/**
+ * Account for a record put before having grown by \p len bytes. Only for an
+ * encoder without a destination buffer, which simulates the encoding size.
+ *
+ * @param enc pointer to encoder
+ * @param len number of bytes
+ *
+ * @return 0 on success, -ENOSPC if the bytes don't fit anymore, -EINVAL
+ *  otherwise */
+int senml_enc_grow(senml_enc_t *enc, size_t len);
 /**
  * Close the encoder and the SenML packet associated with the buffer.
  *
@@ -62,4 +137,41 @@ int senml_enc_put(senml_enc_t *enc, record_t const *rec);
  *  before successfully closing the SenML packet, -EINVAL otherwise. */
 int senml_enc_close(senml_enc_t *enc, size_t *enc_len);
 
+/**
+ * Header of an encoded SenML pack, as produced by this encoder. */
+typedef struct senml_pack_hdr {
+    size_t cnt;     /**< number of records in the pack */
+    size_t hdr_len; /**< length of the header, in bytes */
+    bool has_bn;    /**< the first record sets a base name */
+} senml_pack_hdr_t;
+/**
+ * Parse the header of an encoded SenML pack. Together with
+ * \ref senml_pack_hdr_put() and \ref senml_pack_bn_reset(), this allows
+ * merging several packs into one by concatenating their records.
+ *
+ * @param buf beginning of the pack
+ * @param len length of \p buf. \ref SENML_PACK_HDR_MAXLEN + 2 bytes suffice.
+ * @param hdr filled on success
+ *
+ * @return 0 on success, -EINVAL if the buffer doesn't start with a SenML pack
+ *  header */
+int senml_pack_hdr_parse(void const *buf, size_t len, senml_pack_hdr_t *hdr);
+/**
+ * Write the header of a pack.
+ *
+ * @param buf destination, at least \ref SENML_PACK_HDR_MAXLEN bytes long
+ * @param cnt number of records in the pack
+ *
+ * @return length of the header */
+size_t senml_pack_hdr_put(void *buf, size_t cnt);
+/**
+ * Write a record resetting the base name. When merging packs, this must
+ * precede the records of every pack without base name that follows another
+ * pack, otherwise they would inherit the base name of the latter.
+ *
+ * @param buf destination, at least \ref SENML_PACK_BN_RESET_LEN bytes long
+ *
+ * @return length of the record */
+size_t senml_pack_bn_reset(void *buf);
+
 #endif /* SRC_INC_SENML_ENC_H_ */
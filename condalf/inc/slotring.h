@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @file
+ * @brief ConDaLF bounded multi-producer, single-consumer slot ring
+ *
+ * A static ring of fixed-size slots, after D. Vyukov's bounded queue. A
+ * producer claims a slot, fills it in place and publishes it; the single
+ * consumer takes the published slots in order and releases them. Producers
+ * neither allocate nor take a mutex, so they may be any thread. A producer
+ * finding the ring full doesn't wait: the claim fails and is counted as a drop.
+ *
+ * Example:
+ *
+ * typedef struct { slotring_slot_t hdr; char line[32]; } my_slot_t;
+ * static my_slot_t _slots[8];
+ * static slotring_t _ring = SLOTRING_INIT(_slots);
+ */
+
+#ifndef INC_SLOTRING_H_
+#define INC_SLOTRING_H_
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/**
+ * Header of a slot, MUST be the first member of the slot type. */
+typedef struct {
+    atomic_uint seq;    /**< relative to the slot index, so zero-init works */
+} slotring_slot_t;
+
+typedef struct {
+    void *slots;
+    size_t slot_size;
+    unsigned len;           /**< number of slots, MUST be power of 2 */
+    atomic_uint head;
+    unsigned tail;          /**< consumer only */
+    atomic_uint dropped;    /**< claims failed on a full ring */
+} slotring_t;
+
+/**
+ * Static initializer of a ring over the array @p arr */
+#define SLOTRING_INIT(arr) { \
+    .slots = (arr), \
+    .slot_size = sizeof((arr)[0]), \
+    .len = sizeof(arr) / sizeof((arr)[0]) \
+}
+
+/**
+ * @brief Claim the next free slot. Any thread, lock-free.
+ *
+ * @param ring pointer to the ring
+ * @param pos set to the position of the slot, to be passed to \ref
+ *  slotring_publish()
+ *
+ * @return the slot, NULL if the ring is full */
+void *slotring_claim(slotring_t *ring, unsigned *pos);
+/**
+ * @brief Hand a filled slot over to the consumer.
+ *
+ * @param ring pointer to the ring
+ * @param slot the slot returned by \ref slotring_claim()
+ * @param pos its position */
+void slotring_publish(slotring_t *ring, void *slot, unsigned pos);
+/**
+ * @brief Get the oldest slot, if it is published. Consumer only.
+ *
+ * @param ring pointer to the ring
+ *
+ * @return the slot, NULL if there is none yet */
+void *slotring_peek(slotring_t *ring);
+/**
+ * @brief Give the slot returned by \ref slotring_peek() back to the producers.
+ *  Consumer only.
+ *
+ * @param ring pointer to the ring
+ * @param slot the slot */
+void slotring_release(slotring_t *ring, void *slot);
+/**
+ * @brief Get and clear the number of failed claims.
+ *
+ * @param ring pointer to the ring
+ *
+ * @return number of claims failed since the last call */
+static inline unsigned slotring_dropped(slotring_t *ring)
+{
+    return atomic_exchange(&ring->dropped, 0);
+}
+
+#endif /* INC_SLOTRING_H_ */
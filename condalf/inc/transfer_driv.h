@@ -15,9 +15,19 @@
 #define INC_TRANSFER_DRIV_H_
 
 #include <errno.h>
+#include <stdint.h>
 
 typedef struct transdrv transdrv_t;
 typedef struct transfer_job transfer_job_t;
+/**
+ * The data is of low value and may be lost in transfer, in exchange the driver
+ * may skip acknowledgements and retransmissions. Drivers that don't have a
+ * cheaper way to transfer ignore this flag. */
+#define TRANSJOBF_UNRELIABLE 0x1
+/**
+ * The data is urgent and should be forwarded ahead of any other queued data,
+ * bypassing buffering where possible. */
+#define TRANSJOBF_URGENT 0x2
 
 typedef struct {
     int  (*trysend)(transdrv_t *, transfer_job_t *);
@@ -25,6 +35,7 @@ typedef struct {
     int  (*send)   (transdrv_t *, transfer_job_t *);
     int  (*recv)   (transdrv_t *, transfer_job_t *);
     void (*delete) (transdrv_t **);
+    uint32_t (*holdoff)(transdrv_t *);
 } transdrv_itf_t;
 
 struct transdrv {
@@ -51,6 +62,12 @@ struct transfer_job {
      *   in the callback on success, OR after the transfer call successfully
      *   returns. */
     void (*cb)(transfer_job_t *job, int status);
+    /** Flags, value of TRANSJOBF_* */
+    int flags;
+    /** Time range of the records in the data, in seconds, for drivers that
+     *  index what they store. t_max is 0 if unknown. */
+    uint32_t t_min;
+    uint32_t t_max;
     /** Private data for the driver implementation to use. Do NOT use this
      * externally! Add custom fields below, if necessary. */
     void *_drv_priv;
@@ -123,6 +140,20 @@ static int transdrv_recv(transdrv_t *drv, transfer_job_t *job)
     if (!drv->itf->recv) return -ENOSYS;
     return drv->itf->recv(drv, job);
 }
+/**
+ * Seconds until the driver accepts a transfer again, e.g. because the server
+ * asked to hold off or to pace the transfers. A synchronous transfer refused
+ * with -EAGAIN can be tried again after this. Thread safe.
+ *
+ * @param drv pointer to transfer driver
+ *
+ * @return seconds to wait, 0 if a transfer may start now or the driver has no
+ *  flow control */
+static uint32_t transdrv_holdoff(transdrv_t *drv)
+{
+    if (!drv || !drv->itf->holdoff) return 0;
+    return drv->itf->holdoff(drv);
+}
 /**
  * Delete and deallocated a transfer driver.
  *
@@ -18,19 +18,159 @@
 #include "thread.h"
 #include "condalf_config.h"
 #include "networking.h"
+#include "ztimer.h"
+#include "mempress.h"
+#include <stdbool.h>
 
 #define DLOG_LEVEL DLOG_INF
+#define DLOG_MODULE "logger"
 #include "dlog.h"
 
 typedef struct logg {
     recstr_t stream;
     recser_t ser;
     int flags;
-    transdrv_t *driv;
+    /* Every pack goes to all the drivers, see logg_add_driver() */
+    struct {
+        transdrv_t *driv;
+        int jflags;
+    } drivs[LOGGER_DRIVERS_MAX];
+    unsigned nb_drivs;
     size_t encbuf_size;
+    bool urgent_sent;       /**< an urgent flush happened already */
+    uint32_t last_urgent;   /**< ZTIMER_SEC time of the last urgent flush */
+    /* Deadline flushing, see logg_init_t::max_latency */
+    uint32_t max_latency;
+    size_t min_fill;
+    ztimer_t deadline;
+    msg_t deadline_msg;
+    bool closing;
+    size_t queue_len;
+    /* Pack measurements, see logg_get_stats() */
+    logg_stats_t stats;
+    uint32_t first_pack;
+    uint32_t last_pack;
+    /* Autotuning, see LOGGERF_AUTOTUNE */
+    size_t ram_budget;
+    unsigned target_fill;
+    unsigned at_packs;      /**< packs since the last tuning */
+    size_t at_records;      /**< records in these packs */
+    size_t at_bytes;        /**< encoded Bytes in these packs */
+    unsigned at_qfull;      /**< how many of these were cut by a full queue */
 } logg_t;
 
+/* A pack handed to several drivers, freed along with the last job */
+typedef struct logg_pack {
+    char *buf;
+    unsigned refs;
+    mutex_t lock;
+} logg_pack_t;
+
+typedef struct logg_job {
+    transfer_job_t job;
+    logg_pack_t *pack;
+} logg_job_t;
+
+typedef struct logg_sub {
+    recstr_t stream;
+    logg_t *logger;
+    unsigned idx;
+} logg_sub_t;
+
 static recstr_itf_t const recstr_impl;
+static recstr_itf_t const recstr_sub_impl;
+
+#define LOGG_MSG_DEADLINE   0
+#define LOGG_MSG_SYNC       1
+
+/* Housekeeping thread, flushes the loggers whose deadline expired */
+static kernel_pid_t _hk_pid = KERNEL_PID_UNDEF;
+static mutex_t      _hk_lock = MUTEX_INIT;
+
+static int _logg_flush(logg_t *logger, int jflags);
+
+/* Must be called with the logger lock held */
+static void _logg_arm_deadline(logg_t *logger)
+{
+    if (!logger->max_latency || logger->closing) return;
+    if (ztimer_is_set(ZTIMER_SEC, &logger->deadline)) return;
+
+    ztimer_set_msg(ZTIMER_SEC, &logger->deadline, logger->max_latency,
+        &logger->deadline_msg, _hk_pid);
+}
+
+static void _logg_deadline(logg_t *logger)
+{
+    mutex_lock(&logger->stream.lock);
+
+    size_t const pending = recser_pending(&logger->ser);
+
+    if (logger->closing || pending == 0) {
+        /* nothing to do */
+    } else if (pending < logger->min_fill) {
+        DDBG("%s: %u records pending, waiting for more\n",
+            logger->stream.name, (unsigned)pending);
+        _logg_arm_deadline(logger);
+    } else {
+        DINF("%s: deadline expired, flushing\n", logger->stream.name);
+        _logg_flush(logger, 0);
+        if (recser_pending(&logger->ser)) _logg_arm_deadline(logger);
+    }
+
+    mutex_unlock(&logger->stream.lock);
+}
+
+static void *_logg_hk(void *arg)
+{
+    (void)arg;
+
+    static msg_t msg_queue[LOGGER_HK_QUEUE_LEN];
+    msg_init_queue(msg_queue, LOGGER_HK_QUEUE_LEN);
+    msg_t msg;
+
+    while (1) {
+        msg_receive(&msg);
+
+        switch (msg.type) {
+        case LOGG_MSG_DEADLINE:
+            _logg_deadline((logg_t *)msg.content.ptr);
+            break;
+        case LOGG_MSG_SYNC:
+            /* All the messages sent before were handled */
+            msg_reply(&msg, &msg);
+            break;
+        default:
+            assert(0);
+        }
+    }
+
+    return NULL;
+}
+
+static int _logg_hk_init(void)
+{
+    static char hk_stack[LOGGER_HK_STACKSIZE];
+    int res = 0;
+
+    mutex_lock(&_hk_lock);
+
+    if (_hk_pid == KERNEL_PID_UNDEF) {
+        res = thread_create(
+            hk_stack,
+            sizeof(hk_stack),
+            LOGGER_HK_PRIO,
+            0,
+            _logg_hk,
+            NULL,
+            "logg_hk");
+
+        if (res > 0) _hk_pid = res;
+    }
+
+    mutex_unlock(&_hk_lock);
+
+    return res < 0 ? res : 0;
+}
 
 int logg_create(logg_init_t const *init, recstr_t **log)
 {
@@ -44,11 +184,34 @@ int logg_create(logg_init_t const *init, recstr_t **log)
 
     logger->stream.itf  = &recstr_impl;
     logger->flags       = init->flags;
-    logger->driv        = init->driv;
+    logger->drivs[0].driv   = init->driv;
+    logger->drivs[0].jflags = init->flags & LOGGERF_UNRELIABLE ? TRANSJOBF_UNRELIABLE : 0;
+    logger->nb_drivs        = 1;
     logger->encbuf_size = init->encoding_buf_size;
+    logger->max_latency = init->max_latency;
+    logger->min_fill    = init->min_fill;
+    logger->queue_len   = init->record_queue_size;
+    logger->ram_budget  = init->ram_budget;
+    logger->target_fill = init->target_fill;
+
+    if (!logger->ram_budget) {
+        logger->ram_budget = logger->queue_len * sizeof(record_t) +
+                             logger->encbuf_size;
+    }
+    if (!logger->target_fill || logger->target_fill > 100) {
+        logger->target_fill = LOGGER_AUTOTUNE_TARGET_FILL;
+    }
+
+    logger->deadline_msg.type        = LOGG_MSG_DEADLINE;
+    logger->deadline_msg.content.ptr = logger;
 
     mutex_init(&logger->stream.lock);
 
+    if (logger->max_latency) {
+        res = _logg_hk_init();
+        if (res) goto logg_create_fail;
+    }
+
     ser_buf = malloc(logger->encbuf_size);
     if (!ser_buf) {
         res = -ENOMEM;
@@ -63,7 +226,8 @@ int logg_create(logg_init_t const *init, recstr_t **log)
         .len_limit = init->record_queue_size,
         .buf.len   = logger->encbuf_size,
         .buf.ptr   = ser_buf,
-        .base      = &base
+        .base      = &base,
+        .flags     = init->flags & LOGGERF_RLE ? RECSERF_RLE : 0
     };
 
     res = recser_init(&logger->ser, &ser_init);
@@ -93,9 +257,90 @@ static void _logg_snd_cb(transfer_job_t *job, int err)
     free(job);
 }
 
-static int _logg_send_buffer(logg_t *logger, UsefulBuf *ub)
+static void _logg_pack_release(logg_pack_t *pack)
+{
+    mutex_lock(&pack->lock);
+    unsigned const refs = --pack->refs;
+    mutex_unlock(&pack->lock);
+
+    if (refs) return;
+
+    free(pack->buf);
+    free(pack);
+}
+
+static void _logg_shared_cb(transfer_job_t *job, int err)
+{
+    DDBG("shared job finished: %d\n", err);
+    vfs_close(job->fd);
+    _logg_pack_release(((logg_job_t *)job)->pack);
+    free(job);
+}
+
+/* Hand the same pack to all the drivers */
+static int _logg_send_shared(logg_t *logger, UsefulBuf *ub, int jflags)
+{
+    logg_pack_t *pack = malloc(sizeof(*pack));
+    if (!pack) {
+        free(ub->ptr);
+        ub->ptr = NULL;
+        return -ENOMEM;
+    }
+
+    pack->buf = ub->ptr;
+    /* One reference is held until all the jobs are handed out */
+    pack->refs = logger->nb_drivs + 1;
+    mutex_init(&pack->lock);
+    ub->ptr = NULL;
+
+    int res = 0;
+
+    for (unsigned i = 0; i < logger->nb_drivs; i++) {
+        vstorfile_init_t vf_init = {
+            .buf    = pack->buf,
+            .bufsiz = ub->len,
+            .flags  = VSTORF_BUF_HAS_DATA
+        };
+
+        logg_job_t *ljob = NULL;
+        int fd = vstorfile_open(&vf_init);
+        int res2 = fd < 0 ? fd : 0;
+
+        if (!res2) {
+            ljob = calloc(1, sizeof(*ljob));
+            if (!ljob) res2 = -ENOMEM;
+        }
+
+        if (!res2) {
+            ljob->job.cb    = _logg_shared_cb;
+            ljob->job.fd    = fd;
+            ljob->job.flags = jflags | logger->drivs[i].jflags;
+            ljob->job.t_min = logger->ser.t_min;
+            ljob->job.t_max = logger->ser.t_max;
+            ljob->pack      = pack;
+
+            res2 = transdrv_trysend(logger->drivs[i].driv, &ljob->job);
+        }
+
+        if (res2) {
+            DERR("%s: trysend to driver %u failed: %d\n",
+                logger->stream.name, i, res2);
+            if (fd >= 0) vfs_close(fd);
+            free(ljob);
+            _logg_pack_release(pack);
+            if (!res) res = res2;
+        }
+    }
+
+    _logg_pack_release(pack);
+
+    return res;
+}
+
+static int _logg_send_buffer(logg_t *logger, UsefulBuf *ub, int jflags)
 {
     if (ub->len == 0) return 0;
+    if (logger->nb_drivs > 1) return _logg_send_shared(logger, ub, jflags);
 
     vstorfile_init_t vf_init = {
         .buf    = ub->ptr,
@@ -120,8 +365,11 @@ static int _logg_send_buffer(logg_t *logger, UsefulBuf *ub)
 
     job->cb = _logg_snd_cb;
     job->fd = fd;
+    job->flags = jflags | logger->drivs[0].jflags;
+    job->t_min = logger->ser.t_min;
+    job->t_max = logger->ser.t_max;
 
-    int res = transdrv_trysend(logger->driv, job);
+    int res = transdrv_trysend(logger->drivs[0].driv, job);
 
     if (res) {
         DERR("%s: trysend failed: %d\n", logger->stream.name, res);
@@ -134,29 +382,70 @@ static int _logg_send_buffer(logg_t *logger, UsefulBuf *ub)
     return res;
 }
 
-static int _logg_flush(logg_t *logger)
+/* Allocate an encoding buffer, smaller if the heap is short */
+static void *_logg_buf_alloc(logg_t *logger, size_t *len)
+{
+    *len = logger->encbuf_size;
+    void *buf = malloc(*len);
+    if (buf) return buf;
+
+    mempress_raise();
+    if (*len <= LOGGER_EMERG_BUF_SIZE) return NULL;
+
+    *len = LOGGER_EMERG_BUF_SIZE;
+    buf = malloc(*len);
+    if (buf) DWRN("%s: low memory, emergency buffer\n", logger->stream.name);
+
+    return buf;
+}
+
+/* Must be called with the logger lock held */
+static void _logg_measure(logg_t *logger, size_t records, size_t bytes,
+                          bool queue_full)
+{
+    uint32_t const now = ztimer_now(ZTIMER_SEC);
+
+    if (logger->stats.nb_packs == 0) logger->first_pack = now;
+    logger->last_pack = now;
+
+    logger->stats.nb_packs++;
+    logger->stats.nb_records += records;
+    logger->stats.nb_bytes   += bytes;
+
+    logger->at_packs++;
+    logger->at_records += records;
+    logger->at_bytes   += bytes;
+    if (queue_full) logger->at_qfull++;
+}
+
+static int _logg_flush(logg_t *logger, int jflags)
 {
     int res = 0;
     UsefulBuf ub;
 
     do {
         /* Flush any remaining records in the serializer's queue */
-        ub.len = logger->encbuf_size;
-        ub.ptr = malloc(logger->encbuf_size);
+        ub.ptr = _logg_buf_alloc(logger, &ub.len);
 
         if (!ub.ptr) {
             DDBG("ENOMEM\n");
-            res = ENOMEM;
+            res = -ENOMEM;
             break;
         }
 
+        size_t const pending = recser_pending(&logger->ser);
         res = recser_swap(&logger->ser, &ub);
         if (res == -EAGAIN || res == 0) {
             DDBG("more records to flush...");
             int res2;
 
+            /* Deadline, urgent and explicit flushes make most of the packs
+             * of slow streams */
+            size_t const records = pending - recser_pending(&logger->ser);
+            if (records) _logg_measure(logger, records, ub.len, false);
+
             // TODO: retry?
-            res2 = _logg_send_buffer(logger, &ub);
+            res2 = _logg_send_buffer(logger, &ub, jflags);
             if (res2) {
                 DERR("failed: %s\n", strerror(res2));
                 break;
@@ -174,11 +463,144 @@ static int _logg_flush(logg_t *logger)
     return res;
 }
 
-static int _logg_put(recstr_t *rstr, record_t *rec)
+/* Flush the pending pack right away, unless the urgent traffic cap is hit */
+static void _logg_urgent_flush(logg_t *logger)
+{
+    uint32_t const now = ztimer_now(ZTIMER_SEC);
+
+    if (logger->urgent_sent &&
+        now - logger->last_urgent < LOGGER_URGENT_MIN_INTERVAL) {
+        DWRN("%s: urgent cap hit, record delayed\n", logger->stream.name);
+        return;
+    }
+
+    logger->urgent_sent = true;
+    logger->last_urgent = now;
+
+    DINF("%s: urgent flush\n", logger->stream.name);
+    _logg_flush(logger, TRANSJOBF_URGENT);
+}
+
+static void _logg_autotune_reset(logg_t *logger)
 {
-    logg_t *logger = (logg_t *)rstr;
+    logger->at_packs   = 0;
+    logger->at_records = 0;
+    logger->at_bytes   = 0;
+    logger->at_qfull   = 0;
+}
+
+static size_t _pow2_ceil(size_t n)
+{
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+/* Resize the queue and buffer according to the last packs. Must be called with
+ * the logger lock held, between a swap and the next put. */
+static void _logg_autotune(logg_t *logger)
+{
+    if (!(logger->flags & LOGGERF_AUTOTUNE)) return;
+    if (logger->at_packs < LOGGER_AUTOTUNE_PACKS) return;
+
+    if (mempress_high()) {
+        /* neither grow, nor measure the emergency buffers */
+        _logg_autotune_reset(logger);
+        return;
+    }
+
+    size_t const recs  = logger->at_records / logger->at_packs;
+    size_t const bytes = logger->at_bytes / logger->at_packs;
+    bool const qbound  = logger->at_qfull * 2 > logger->at_packs;
+
+    _logg_autotune_reset(logger);
+
+    if (!recs || !bytes) return;
 
-    if (!rec) return _logg_flush(logger);
+    size_t q = logger->queue_len;
+    size_t b = logger->encbuf_size;
+    unsigned const fill = bytes * 100 / b;
+
+    if (qbound) {
+        /* The packs are cut by the queue: more records per pack if the budget
+         * allows it, otherwise a buffer that matches what the queue yields */
+        if (fill >= logger->target_fill) return;
+
+        if ((q * 2) * sizeof(record_t) + b <= logger->ram_budget) {
+            q *= 2;
+        } else {
+            b = bytes * 100 / logger->target_fill;
+        }
+    } else {
+        /* The packs are cut by the buffer: the queue only needs some margin
+         * above the records per pack, spend the rest on the buffer */
+        size_t const nq = _pow2_ceil(recs + recs / 4 + 1);
+        if (nq < q) q = nq;
+
+        size_t const used = q * sizeof(record_t) + b;
+        if (used < logger->ram_budget) {
+            size_t spare = logger->ram_budget - used;
+            if (spare > b) spare = b;
+            b += spare;
+        }
+    }
+
+    if (q < LOGGER_AUTOTUNE_MIN_QUEUE) q = LOGGER_AUTOTUNE_MIN_QUEUE;
+    if (b < LOGGER_AUTOTUNE_MIN_BUF)   b = LOGGER_AUTOTUNE_MIN_BUF;
+    /* the queued records must still fit */
+    if (q <= recser_pending(&logger->ser)) q = logger->queue_len;
+
+    if (q == logger->queue_len && b == logger->encbuf_size) return;
+
+    UsefulBuf ub = {
+        .ptr = malloc(b),
+        .len = b
+    };
+    if (!ub.ptr) return;
+
+    int res = recser_resize(&logger->ser, q, &ub);
+
+    if (res) {
+        DWRN("%s: autotune to %u/%u failed: %d\n", logger->stream.name,
+            (unsigned)q, (unsigned)b, res);
+    } else {
+        DINF("%s: autotune: %u recs/pack, %u%% fill -> queue %u, buffer %u\n",
+            logger->stream.name, (unsigned)recs, fill, (unsigned)q, (unsigned)b);
+        logger->queue_len   = q;
+        logger->encbuf_size = b;
+    }
+
+    /* On success, this is the previous buffer */
+    free(ub.ptr);
+}
+
+/* No buffer to swap to. Must be called with the logger lock held. */
+static int _logg_shed(logg_t *logger, record_t *rec, int put_res)
+{
+    if (put_res == -EAGAIN) {
+        /* The record is queued, the next put tries to swap again */
+        DWRN("%s: out of memory, flush postponed\n", logger->stream.name);
+        return 0;
+    }
+
+    /* The queue is full, make room by dropping the oldest record */
+    int res = recser_drop(&logger->ser, !(rec->flags & RECORDF_URGENT));
+    if (res) {
+        DERR("%s: out of memory, cannot drop: %d\n", logger->stream.name, res);
+        return -ENOMEM;
+    }
+
+    logger->stats.nb_dropped++;
+    DWRN("%s: out of memory, oldest record dropped\n", logger->stream.name);
+
+    res = recser_put(&logger->ser, rec);
+
+    return res == -EAGAIN ? 0 : res;
+}
+
+static int _logg_put_base(logg_t *logger, record_t *rec, unsigned base)
+{
+    if (!rec) return _logg_flush(logger, 0);
 
     record_t nrec = { 0 };
     UsefulBuf ub = { 0 };
@@ -188,6 +610,9 @@ static int _logg_put(recstr_t *rstr, record_t *rec)
     int res = record_copy(&nrec, rec);
     if (res) return res;
 
+    nrec.base = base;
+    bool const urgent = nrec.flags & RECORDF_URGENT;
+
     int put_res = recser_put(&logger->ser, &nrec);
 
     switch (put_res) {
@@ -197,15 +622,14 @@ static int _logg_put(recstr_t *rstr, record_t *rec)
         DDBG("cannot add: %s, swapping...",
             put_res == -EAGAIN ? "EAGAIN" : "ENOSPC");
 
-        ub.len = logger->encbuf_size;
-        ub.ptr = malloc(logger->encbuf_size);
+        ub.ptr = _logg_buf_alloc(logger, &ub.len);
 
         if (!ub.ptr) {
-            DERR("failed: ENOMEM\n");
-            retval = -ENOMEM;
+            retval = _logg_shed(logger, &nrec, put_res);
             break;
         }
 
+        size_t const pending = recser_pending(&logger->ser);
         res = recser_swap(&logger->ser, &ub);
 
         if (res && res != -EAGAIN) {
@@ -216,8 +640,11 @@ static int _logg_put(recstr_t *rstr, record_t *rec)
 
         DDBG("done!\n");
 
+        _logg_measure(logger, pending - recser_pending(&logger->ser), ub.len,
+            put_res == -ENOSPC);
+
         DINF("sending buffer...\n");
-        res = _logg_send_buffer(logger, &ub);
+        res = _logg_send_buffer(logger, &ub, 0);
 
         if (res) {
             DERR("_send_buffer err: %d\n", res);
@@ -225,6 +652,8 @@ static int _logg_put(recstr_t *rstr, record_t *rec)
             DINF("buffer sent!\n");
         }
 
+        _logg_autotune(logger);
+
         if (put_res == -ENOSPC) {
             /* The queue was full -> the record wasn't added, try again */
             put_res = recser_put(&logger->ser, &nrec);
@@ -245,9 +674,172 @@ static int _logg_put(recstr_t *rstr, record_t *rec)
     record_freedata(&nrec);
     /* Only release the original record data on success */
     if (!retval) record_freedata(rec);
+
+    if (!retval && urgent) _logg_urgent_flush(logger);
+    if (!retval) _logg_arm_deadline(logger);
+
     return retval;
 }
 
+static int _logg_put(recstr_t *rstr, record_t *rec)
+{
+    return _logg_put_base((logg_t *)rstr, rec, 0);
+}
+
+int logg_substream_create(recstr_t *log, logg_substream_init_t const *init,
+                          recstr_t **sub)
+{
+    if (!log || !init || !sub) return -EINVAL;
+    if (log->itf != &recstr_impl) return -EINVAL;
+
+    logg_t *logger = (logg_t *)log;
+
+    logg_sub_t *nsub = calloc(1, sizeof(*nsub));
+    if (!nsub) return -ENOMEM;
+
+    record_base_t base = {
+        .name = (char *)init->base_name
+    };
+
+    mutex_lock(&log->lock);
+    int res = recser_sub_add(&logger->ser, &base, init->quota);
+    mutex_unlock(&log->lock);
+
+    if (res < 0) {
+        free(nsub);
+        return res;
+    }
+
+    nsub->stream.itf = &recstr_sub_impl;
+    nsub->logger     = logger;
+    nsub->idx        = res;
+
+    mutex_init(&nsub->stream.lock);
+
+    strncpy(
+        nsub->stream.name,
+        init->name ? init->name : "<none>",
+        RECORDSTREAM_MAX_STR_LEN);
+
+    nsub->stream.name[RECORDSTREAM_MAX_STR_LEN] = '\0';
+
+    *sub = (recstr_t *)nsub;
+    return 0;
+}
+
+static int _logg_sub_put(recstr_t *rstr, record_t *rec)
+{
+    logg_sub_t *sub = (logg_sub_t *)rstr;
+    logg_t *logger = sub->logger;
+
+    mutex_lock(&logger->stream.lock);
+    int res = _logg_put_base(logger, rec, sub->idx);
+    mutex_unlock(&logger->stream.lock);
+
+    return res;
+}
+
+static int _logg_sub_close(recstr_t **rstr)
+{
+    logg_sub_t *sub = (logg_sub_t *)*rstr;
+    logg_t *logger = sub->logger;
+
+    mutex_lock(&logger->stream.lock);
+    /* The records of the substream are flushed along with the others. If some
+     * remain queued, the serializer keeps the base until they are out. */
+    int res = _logg_flush(logger, 0);
+    recser_sub_remove(&logger->ser, sub->idx);
+    mutex_unlock(&logger->stream.lock);
+
+    free(sub);
+    *rstr = NULL;
+
+    return res;
+}
+
+int logg_resize(recstr_t *log, size_t record_queue_size, size_t encoding_buf_size)
+{
+    if (!log || log->itf != &recstr_impl) return -EINVAL;
+    if (record_queue_size == 0 || encoding_buf_size == 0) return -EINVAL;
+
+    logg_t *logger = (logg_t *)log;
+    int res;
+
+    UsefulBuf ub = {
+        .ptr = malloc(encoding_buf_size),
+        .len = encoding_buf_size
+    };
+    if (!ub.ptr) return -ENOMEM;
+
+    mutex_lock(&log->lock);
+
+    /* Flush first, so the new sizes apply to the following packs */
+    res = _logg_flush(logger, 0);
+    if (res == 0) res = recser_resize(&logger->ser, record_queue_size, &ub);
+    if (res == 0) {
+        logger->queue_len   = record_queue_size;
+        logger->encbuf_size = encoding_buf_size;
+        /* Autotuning starts over from the new sizes, rather than moving back
+         * toward the previous footprint */
+        logger->ram_budget  = record_queue_size * sizeof(record_t) +
+                              encoding_buf_size;
+        _logg_autotune_reset(logger);
+    }
+
+    mutex_unlock(&log->lock);
+
+    if (res) DERR("%s: cannot resize: %d\n", log->name, res);
+
+    /* On success, this is the previous buffer */
+    free(ub.ptr);
+
+    return res;
+}
+
+int logg_add_driver(recstr_t *log, transdrv_t *driv, int flags)
+{
+    if (!log || log->itf != &recstr_impl || !driv) return -EINVAL;
+
+    logg_t *logger = (logg_t *)log;
+    int res = 0;
+
+    mutex_lock(&log->lock);
+
+    if (logger->nb_drivs == LOGGER_DRIVERS_MAX) {
+        res = -ENOSPC;
+    } else {
+        logger->drivs[logger->nb_drivs].driv   = driv;
+        logger->drivs[logger->nb_drivs].jflags =
+            flags & LOGGERF_UNRELIABLE ? TRANSJOBF_UNRELIABLE : 0;
+        logger->nb_drivs++;
+    }
+
+    mutex_unlock(&log->lock);
+
+    return res;
+}
+
+int logg_get_stats(recstr_t *log, logg_stats_t *stats)
+{
+    if (!log || log->itf != &recstr_impl || !stats) return -EINVAL;
+
+    logg_t *logger = (logg_t *)log;
+
+    mutex_lock(&log->lock);
+
+    *stats = logger->stats;
+    if (stats->nb_packs > 1) {
+        stats->pack_interval = (logger->last_pack - logger->first_pack) /
+                               (stats->nb_packs - 1);
+    }
+    stats->record_queue_size = logger->queue_len;
+    stats->encoding_buf_size = logger->encbuf_size;
+
+    mutex_unlock(&log->lock);
+
+    return 0;
+}
+
 static int _logg_close(recstr_t **rstr)
 {
     logg_t *logger = (logg_t *)*rstr;
@@ -256,7 +848,18 @@ static int _logg_close(recstr_t **rstr)
 
     DDBG("closing...\n");
 
-    res = _logg_flush(logger);
+    if (logger->max_latency) {
+        mutex_lock(&logger->stream.lock);
+        logger->closing = true;
+        ztimer_remove(ZTIMER_SEC, &logger->deadline);
+        mutex_unlock(&logger->stream.lock);
+
+        /* A deadline message might still be queued */
+        msg_t msg = { .type = LOGG_MSG_SYNC };
+        msg_send_receive(&msg, &msg, _hk_pid);
+    }
+
+    res = _logg_flush(logger, 0);
 
     /* Invalidate the serializer */
     ub.ptr = NULL;
@@ -273,3 +876,8 @@ static recstr_itf_t const recstr_impl = {
     .put    = _logg_put,
     .close  = _logg_close
 };
+
+static recstr_itf_t const recstr_sub_impl = {
+    .put    = _logg_sub_put,
+    .close  = _logg_sub_close
+};
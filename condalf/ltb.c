@@ -30,20 +30,33 @@
 #include "vfs.h"
 #include "data_pool.h"
 #include "malloc.h"
+#include "ztimer.h"
+#include "senml_dec.h"
+#include "mempress.h"
 #include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
 #define DLOG_LEVEL DLOG_INF
+#define DLOG_MODULE "ltb"
 #include "dlog.h"
 
 typedef struct ltb ltb_t;
 
+/* Time range of the records of a pool file, see ltb_query() */
+typedef struct ltb_idx {
+    uint32_t fid;   /**< 0 for an unused entry */
+    uint32_t t_min;
+    uint32_t t_max;
+} ltb_idx_t;
+
 struct ltb {
     transdrv_t driv;
     ltb_t *next;
     char *pooldir;
     transdrv_t *sender;
+    ltb_idx_t idx[LTB_INDEX_LEN];
     union {
         struct {
             char _padding[2];
@@ -64,8 +77,14 @@ static bool        (*_ext_cond)(void) = NULL;
 
 #define LTB_QUEUE_MSGQUEUE_LEN 4
 
-#define DISPATCH_TYPE_ASYNC 0
-#define DISPATCH_TYPE_SYNC  1
+#define DISPATCH_TYPE_ASYNC   0
+#define DISPATCH_TYPE_SYNC    1
+#define DISPATCH_TYPE_RESUME  2
+
+/* Resumes a publishing session the sender asked to postpone. Sent from ISR,
+ * so it cannot carry a dispatch unit. */
+static ztimer_t     _resume_timer;
+static msg_t        _resume_msg = { .type = DISPATCH_TYPE_RESUME };
 
 typedef void (*dispatch_cb_t)(void *);
 typedef struct dispatch_unit dispatch_unit_t;
@@ -84,6 +103,8 @@ struct dispatch_sync_unit {
     cond_t cond;
 };
 
+static void _ltb_upd_pub_cond(ltb_t *ltb);
+
 static int _ltb_dispatch(
     dispatch_cb_t cb,
     void *arg)
@@ -192,6 +213,10 @@ static void *_ltb_dispatcher(void *arg)
 
             break;
         }
+        case DISPATCH_TYPE_RESUME:
+            DDBG("resuming\n");
+            _ltb_upd_pub_cond(NULL);
+            break;
         default:
             assert(0);
         }
@@ -200,6 +225,69 @@ static void *_ltb_dispatcher(void *arg)
     return NULL;
 }
 
+/* Read a whole file into a new buffer */
+static int _ltb_read_all(int fd, char **buf, size_t *len)
+{
+    off_t const size = vfs_lseek(fd, 0, SEEK_END);
+    if (size < 0) return size;
+
+    *buf = malloc(size ? size : 1);
+    if (!*buf) {
+        mempress_raise();
+        return -ENOMEM;
+    }
+
+    vfs_lseek(fd, 0, SEEK_SET);
+
+    if (vfs_read(fd, *buf, size) != size) {
+        free(*buf);
+        *buf = NULL;
+        return -EIO;
+    }
+
+    *len = size;
+    return 0;
+}
+
+static ltb_idx_t *_ltb_index_find(ltb_t *ltb, uint32_t fid)
+{
+    for (unsigned i = 0; i < LTB_INDEX_LEN; i++) {
+        if (ltb->idx[i].fid == fid) return &ltb->idx[i];
+    }
+
+    return NULL;
+}
+
+/* Record the time range of a file added to the pool, as the job tells, see
+ * transfer_job_t::t_max. Files without an entry, e.g. stored before a reboot,
+ * are decoded by every query. */
+static void _ltb_index_add(ltb_t *ltb, uint32_t fid, transfer_job_t const *job)
+{
+    if (!job->t_max) {
+        DDBG("%s: file %u without time range\n", ltb->name, (unsigned)fid);
+        return;
+    }
+
+    ltb_idx_t const entry = { .fid = fid, .t_min = job->t_min, .t_max = job->t_max };
+
+    /* Take a free entry, or the one of the oldest file */
+    ltb_idx_t *slot = &ltb->idx[0];
+    for (unsigned i = 0; i < LTB_INDEX_LEN && slot->fid; i++) {
+        if (!ltb->idx[i].fid || ltb->idx[i].fid < slot->fid) slot = &ltb->idx[i];
+    }
+
+    *slot = entry;
+}
+
+static void _ltb_index_remove(ltb_t *ltb, char const *fname)
+{
+    uint32_t fid;
+    if (dpool_file_id(fname, &fid)) return;
+
+    ltb_idx_t *entry = _ltb_index_find(ltb, fid);
+    if (entry) entry->fid = 0;
+}
+
 static int _ltb_publish(void *arg)
 {
     _publishing = true;
@@ -228,6 +316,17 @@ static int _ltb_publish(void *arg)
     };
     res = transdrv_send(ltb->sender, &job);
     vfs_close(fd);
+    if (res == -EAGAIN) {
+        /* The server paces us, end the session and resume as soon as the
+         * sender accepts transfers again */
+        uint32_t delay = transdrv_holdoff(ltb->sender);
+        if (!delay) delay = LTB_RESUME_DELAY;
+
+        DINF("sender busy, resuming in %us\n", (unsigned)delay);
+        ztimer_set_msg(ZTIMER_SEC, &_resume_timer, delay,
+            &_resume_msg, _ltb_queue);
+        goto _publish_end;
+    }
     if (res < 0) {
         DERR("transfer_send err: %d", res);
         goto _publish_end;
@@ -238,6 +337,7 @@ static int _ltb_publish(void *arg)
         DERR("unlink fail: %d\n", res);
     } else {
         _nb_files_total--;
+        _ltb_index_remove(ltb, fname);
     }
 
     res = _ltb_dispatch((dispatch_cb_t)_ltb_publish, NULL);
@@ -297,6 +397,20 @@ int ltb_subsys_init(ltb_subsys_init_t const *init)
     return 0;
 }
 
+static void _ltb_set_nb_files_lim(void *arg)
+{
+    _nb_files_lim = (size_t)(uintptr_t)arg;
+    DINF("files limit: %u\n", (unsigned)_nb_files_lim);
+
+    /* A lower limit might already be met */
+    _ltb_upd_pub_cond(NULL);
+}
+
+int ltb_set_nb_files_lim(size_t nb_files_lim)
+{
+    return _ltb_dispatch(_ltb_set_nb_files_lim, (void *)(uintptr_t)nb_files_lim);
+}
+
 void _force_publish(void *arg)
 {
     if (!_publishing) {
@@ -389,6 +503,29 @@ _ltb_create_err:
     return res;
 }
 
+/* Send an urgent job directly, without going through the pool. Returns 0 on
+ * success, otherwise the job must be stored. */
+static int _ltb_bypass(ltb_t *ltb, transfer_job_t *job)
+{
+    if (!ltb->sender) return -ENOTCONN;
+
+    /* A copy without callback, the sender must not finish the job */
+    transfer_job_t bypass = {
+        .fd = job->fd,
+        .flags = job->flags
+    };
+
+    vfs_lseek(job->fd, 0, SEEK_SET);
+    int res = transdrv_send(ltb->sender, &bypass);
+    if (res) {
+        DWRN("%s: urgent bypass failed: %d, storing\n", ltb->name, res);
+    } else {
+        DINF("%s: urgent job sent\n", ltb->name);
+    }
+
+    return res;
+}
+
 static void _ltb_try_send_disp(void *arg)
 {
     transfer_job_t *job = (transfer_job_t *)arg;
@@ -396,6 +533,11 @@ static void _ltb_try_send_disp(void *arg)
 
     static char buf[64];
 
+    if ((job->flags & TRANSJOBF_URGENT) && _ltb_bypass(ltb, job) == 0) {
+        if (job->cb) job->cb(job, 0);
+        return;
+    }
+
     char tmp_path[strlen(ltb->pooldir) + strlen(ltb->tmpfil_name) + 1];
     strcpy(tmp_path, ltb->pooldir);
     strcat(tmp_path, ltb->tmpfil_name);
@@ -427,13 +569,16 @@ static void _ltb_try_send_disp(void *arg)
         goto _try_send_cb_end;
     }
 
-    res = dpool_move_file(ltb->pooldir, tmp_path);
+    uint32_t fid;
+    res = dpool_move_file(ltb->pooldir, tmp_path, &fid);
 
     if (res) {
         DEBUG_PRINT("%s: error moving to pool: %d\n", __func__, res);
         goto _try_send_cb_end;
     }
 
+    _ltb_index_add(ltb, fid, job);
+
     _nb_files_total++;
 
 _try_send_cb_end:
@@ -467,6 +612,142 @@ static void _ltb_delete(transdrv_t **drv)
     *ltbpp = NULL;
 }
 
+typedef struct ltb_qry {
+    recstr_t stream;
+    ltb_t *ltb;
+    ltb_query_t q;
+    uint32_t next_fid;  /**< lowest id of the files left to read */
+    char *pack;         /**< pack being decoded, NULL if none */
+    senml_dec_t dec;
+} ltb_qry_t;
+
+static recstr_itf_t const ltb_qry_impl;
+
+static bool _ltb_qry_overlaps(ltb_query_t const *q, ltb_idx_t const *idx)
+{
+    if (idx->t_max < q->t_from) return false;
+    if (q->t_to && idx->t_min >= q->t_to) return false;
+    return true;
+}
+
+/* Load the next pool file that may match the query. Runs in the dispatcher,
+ * as the pool might be published concurrently. */
+static void *_ltb_qry_load(void *arg)
+{
+    ltb_qry_t *qry = (ltb_qry_t *)arg;
+    char fname[64];
+    uint32_t fid;
+    int res;
+
+    while (!(res = dpool_get_next_file(qry->ltb->pooldir, qry->next_fid,
+                                       fname, sizeof(fname), &fid))) {
+        qry->next_fid = fid + 1;
+
+        ltb_idx_t const *idx = _ltb_index_find(qry->ltb, fid);
+        if (idx && !_ltb_qry_overlaps(&qry->q, idx)) {
+            DDBG("%s skipped\n", fname);
+            continue;
+        }
+
+        res = vfs_open(fname, O_RDONLY, 0);
+        if (res < 0) break;
+
+        int const fd = res;
+        size_t len;
+        res = _ltb_read_all(fd, &qry->pack, &len);
+        vfs_close(fd);
+
+        if (res) break;
+
+        res = senml_dec_init(&qry->dec, qry->pack, len);
+        if (!res) break;
+
+        DWRN("%s: not a pack, skipped\n", fname);
+        free(qry->pack);
+        qry->pack = NULL;
+    }
+
+    return (void *)(intptr_t)res;
+}
+
+static bool _ltb_qry_match(ltb_query_t const *q, record_t const *rec)
+{
+    if (rec->timestamp.seconds < q->t_from) return false;
+    if (q->t_to && rec->timestamp.seconds >= q->t_to) return false;
+    if (q->name && strcmp(q->name, rec->name)) return false;
+    return true;
+}
+
+static int _ltb_qry_get(recstr_t *rstr, record_t *rec)
+{
+    ltb_qry_t *qry = (ltb_qry_t *)rstr;
+
+    while (1) {
+        if (!qry->pack) {
+            int res = (intptr_t)_ltb_dispatch_sync(_ltb_qry_load, qry);
+            if (res == -ENOENT) return -ENODATA;
+            if (res) return res;
+        }
+
+        int res = senml_dec_next(&qry->dec, rec);
+
+        if (res == 0) {
+            if (_ltb_qry_match(&qry->q, rec)) return 0;
+            record_freedata(rec);
+            continue;
+        }
+
+        if (res != -ENODATA) DWRN("%s: pack dropped: %d\n", rstr->name, res);
+
+        free(qry->pack);
+        qry->pack = NULL;
+    }
+}
+
+static int _ltb_qry_close(recstr_t **rstr)
+{
+    ltb_qry_t *qry = (ltb_qry_t *)*rstr;
+
+    free(qry->pack);
+    free((char *)qry->q.name);
+    free(qry);
+    *rstr = NULL;
+
+    return 0;
+}
+
+int ltb_query(transdrv_t *drv, ltb_query_t const *query, recstr_t **rs)
+{
+    if (!drv || drv->itf != &ltb_impl || !query || !rs) return -EINVAL;
+
+    ltb_qry_t *qry = calloc(1, sizeof(*qry));
+    if (!qry) return -ENOMEM;
+
+    qry->q = *query;
+    if (query->name) {
+        qry->q.name = strdup(query->name);
+        if (!qry->q.name) {
+            free(qry);
+            return -ENOMEM;
+        }
+    }
+
+    qry->stream.itf = &ltb_qry_impl;
+    qry->ltb = (ltb_t *)drv;
+
+    mutex_init(&qry->stream.lock);
+    strncpy(qry->stream.name, qry->ltb->name, RECORDSTREAM_MAX_STR_LEN);
+    qry->stream.name[RECORDSTREAM_MAX_STR_LEN] = '\0';
+
+    *rs = (recstr_t *)qry;
+    return 0;
+}
+
+static recstr_itf_t const ltb_qry_impl = {
+    .get    = _ltb_qry_get,
+    .close  = _ltb_qry_close
+};
+
 static transdrv_itf_t const ltb_impl = {
     .trysend = _ltb_try_send,
     .delete  = _ltb_delete
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+#include "mempress.h"
+#include "condalf_config.h"
+#include "ztimer.h"
+#include <stdatomic.h>
+
+/* Lock-free, the RDLOG producers check the signal on every record */
+static _Atomic uint32_t _last_raise;
+static _Atomic uint32_t _cnt;
+
+void mempress_raise(void)
+{
+    atomic_store_explicit(&_last_raise, ztimer_now(ZTIMER_SEC),
+        memory_order_relaxed);
+    /* Publishes _last_raise to the readers of _cnt */
+    atomic_fetch_add_explicit(&_cnt, 1, memory_order_release);
+}
+
+bool mempress_high(void)
+{
+    if (!atomic_load_explicit(&_cnt, memory_order_acquire)) return false;
+
+    uint32_t const last = atomic_load_explicit(&_last_raise,
+        memory_order_relaxed);
+
+    return ztimer_now(ZTIMER_SEC) - last < MEMPRESS_HOLD;
+}
+
+uint32_t mempress_count(void)
+{
+    return atomic_load_explicit(&_cnt, memory_order_relaxed);
+}
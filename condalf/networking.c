@@ -12,11 +12,13 @@
 #include "remote_res.h"
 #include <errno.h>
 #include <stdio.h>
+#include <inttypes.h>
 #include <vfs.h>
 #include <fcntl.h>
 #include <string.h>
 #include <malloc.h>
 #include <mutex.h>
+#include <stdbool.h>
 #include "fmt.h"
 #include "od.h"
 #include "net/gcoap.h"
@@ -24,10 +26,30 @@
 #include "cond.h"
 #include "condalf_config.h"
 
+#if CONDALF_USE_DTLS == 1
+#include "net/credman.h"
+#include "net/dsm.h"
+#include "net/sock/dtls.h"
+#include "ztimer.h"
+#endif
+
 #define DLOG_LEVEL DLOG_INF
+#define DLOG_MODULE "net"
 #include "dlog.h"
 
 #define LENGHT_OF_SEND_PAYLOAD (1 << CDF_BLOCK_SIZE_EXP)
+/* IPv6 minimum link MTU (RFC 8200), assumed if the interface is unknown */
+#define IPV6_MIN_MTU 1280
+/* IPv6 and UDP header sizes */
+#define IPV6_UDP_HDR_LEN (40 + 8)
+#if CONDALF_USE_DTLS == 1
+/* DTLS 1.2 record header, explicit nonce and CCM_8 tag */
+#define DTLS_RECORD_OVERHEAD (13 + 8 + 8)
+#else
+#define DTLS_RECORD_OVERHEAD 0
+#endif
+/* RFC 7252, 5.10.5: Max-Age defaults to 60 seconds if absent */
+#define COAP_MAX_AGE_DEFAULT 60
 
 static const vfs_file_ops_t network_impl;
 
@@ -42,6 +64,8 @@ typedef struct network_privdata {
 	uint8_t buf_to_send[1024];
 	uint16_t number_of_bytes;
 	uint8_t err;
+	bool busy;
+	net_hint_t *hint;
 	coap_block1_t block1_init;
 	cond_t send_cond;
 	mutex_t lock;
@@ -127,6 +151,113 @@ static ssize_t _init_remote(sock_udp_ep_t *remote, char *addr_str, uint16_t port
     return 1;
 }
 
+#if CONDALF_USE_DTLS == 1
+/* The requests within gcoap_req_send() per remote. gcoap performs the
+ * handshake in there if it has no session for the remote yet, so a handshake
+ * takes from the start of the oldest request to its remote. */
+typedef struct {
+    sock_udp_ep_t remote;
+    uint32_t start;     /**< ZTIMER_MSEC time of the oldest request */
+    unsigned pending;   /**< # requests, 0 if the entry is unused */
+} net_dtls_req_t;
+
+static mutex_t          _dtls_lock = MUTEX_INIT;
+static net_dtls_stats_t _dtls_stats;
+static net_dtls_req_t   _dtls_reqs[CONFIG_DSM_PEER_MAX];
+
+/* The handshakes are seen through the events of gcoap's DTLS sock, which needs
+ * the sock_async support of the tinydtls sock */
+#if defined(MODULE_TINYDTLS_SOCK_DTLS) && defined(MODULE_SOCK_ASYNC)
+#define NET_DTLS_HOOK 1
+static sock_dtls_cb_t   _dtls_gcoap_cb;
+#endif
+
+/* Returns the entry of remote, or an unused one if remote is NULL. Must be
+ * called with the lock held. */
+static net_dtls_req_t *_dtls_req_find(sock_udp_ep_t const *remote)
+{
+    for (unsigned i = 0; i < CONFIG_DSM_PEER_MAX; i++) {
+        net_dtls_req_t *req = &_dtls_reqs[i];
+
+        if (!remote && !req->pending) return req;
+        if (remote && req->pending && sock_udp_ep_equal(&req->remote, remote)) {
+            return req;
+        }
+    }
+
+    return NULL;
+}
+
+#ifdef NET_DTLS_HOOK
+/* Sees the events of gcoap's DTLS sock before gcoap does. A session gets ready
+ * once its handshake is done, whichever request started it. */
+static void _dtls_sock_cb(sock_dtls_t *sock, sock_async_flags_t flags, void *arg)
+{
+    sock_dtls_session_t session;
+    sock_udp_ep_t remote;
+
+    if ((flags & SOCK_ASYNC_CONN_RDY) &&
+        sock_dtls_get_event_session(sock, &session)) {
+        sock_dtls_session_get_udp_ep(&session, &remote);
+        uint32_t const now = ztimer_now(ZTIMER_MSEC);
+
+        mutex_lock(&_dtls_lock);
+
+        _dtls_stats.nb_handshakes++;
+
+        net_dtls_req_t *req = _dtls_req_find(&remote);
+        if (req) {
+            uint32_t const duration = now - req->start;
+            _dtls_stats.handshake_ms += duration;
+            _dtls_stats.last_handshake_ms = duration;
+            DINF("DTLS handshake took %" PRIu32 "ms\n", duration);
+        }
+
+        mutex_unlock(&_dtls_lock);
+    }
+
+    if (_dtls_gcoap_cb) _dtls_gcoap_cb(sock, flags, arg);
+}
+#endif
+
+static ssize_t _req_send(const uint8_t *buf, size_t len,
+                         const sock_udp_ep_t *remote,
+                         gcoap_resp_handler_t resp_handler, void *context)
+{
+    mutex_lock(&_dtls_lock);
+
+    net_dtls_req_t *req = _dtls_req_find(remote);
+    if (!req) req = _dtls_req_find(NULL);
+    /* Otherwise, more remotes than sessions: the handshake is counted, but
+     * not timed */
+    if (req && !req->pending++) {
+        req->remote = *remote;
+        req->start  = ztimer_now(ZTIMER_MSEC);
+    }
+
+    mutex_unlock(&_dtls_lock);
+
+    ssize_t res = gcoap_req_send(buf, len, remote, resp_handler, context);
+
+    mutex_lock(&_dtls_lock);
+    if (req) req->pending--;
+    mutex_unlock(&_dtls_lock);
+
+    return res;
+}
+
+void net_dtls_get_stats(net_dtls_stats_t *stats)
+{
+    if (!stats) return;
+
+    mutex_lock(&_dtls_lock);
+    *stats = _dtls_stats;
+    mutex_unlock(&_dtls_lock);
+}
+#else
+#define _req_send gcoap_req_send
+#endif
+
 /* Writes and sends next block for COAP resource request. */
 static int _do_block_put(network_privdata_t* privdata)
 {
@@ -139,7 +270,7 @@ static int _do_block_put(network_privdata_t* privdata)
     len += coap_payload_put_bytes(&privdata->pdu, &privdata->buf_to_send,
                                     privdata->number_of_bytes);
 
-    ssize_t res = gcoap_req_send((uint8_t *)privdata->pdu.hdr, len, &privdata->remote, _resp_handler, privdata);
+    ssize_t res = _req_send((uint8_t *)privdata->pdu.hdr, len, &privdata->remote, _resp_handler, privdata);
     if (res < 0) {
         printf("client: msg send failed: %d\n", (int)res);
         return 1;
@@ -149,6 +280,31 @@ static int _do_block_put(network_privdata_t* privdata)
 
 
 
+/* Pick up the flow control hints the server attached to a response. */
+static void _parse_hints(network_privdata_t *privdata, coap_pkt_t *pdu)
+{
+    unsigned const code = coap_get_code_raw(pdu);
+    uint32_t val;
+
+    if (code == COAP_CODE_SERVICE_UNAVAILABLE ||
+        code == COAP_CODE_TOO_MANY_REQUESTS) {
+        privdata->busy = true;
+
+        if (coap_opt_get_uint(pdu, COAP_OPT_MAX_AGE, &val) < 0) {
+            val = COAP_MAX_AGE_DEFAULT;
+        }
+
+        DWRN("server busy, retry after %" PRIu32 "s\n", val);
+        if (privdata->hint) privdata->hint->retry_after = val;
+    }
+
+    if (privdata->hint &&
+        coap_opt_get_uint(pdu, CDF_COAP_OPT_PACING, &val) == 0) {
+        DDBG("pacing: %" PRIu32 "s\n", val);
+        privdata->hint->min_interval = val;
+    }
+}
+
 /* Response handler for client request to COAP resource. */
 static void _resp_handler(const gcoap_request_memo_t *memo, coap_pkt_t* pdu,
                           const sock_udp_ep_t *remote)
@@ -164,6 +320,9 @@ static void _resp_handler(const gcoap_request_memo_t *memo, coap_pkt_t* pdu,
         printf("gcoap: error in response\n");
         goto end;
     }
+
+    _parse_hints(privdata, pdu);
+
     /* send next block if present */
     if (coap_get_code_raw(pdu) == COAP_CODE_CONTINUE) {
         privdata->block1_init.blknum++;
@@ -186,10 +345,41 @@ static void _resp_handler(const gcoap_request_memo_t *memo, coap_pkt_t* pdu,
 
 int net_subsys_init(net_subsys_init_t *init)
 {
+#if CONDALF_USE_DTLS == 1
+    if (!init || !init->dtls_cred) return -EINVAL;
+
+    int res = credman_add(init->dtls_cred);
+    if (res != CREDMAN_OK && res != CREDMAN_EXIST) {
+        DERR("cannot add credential: %d\n", res);
+        return -EINVAL;
+    }
+
+    sock_dtls_t *sock = gcoap_get_sock_dtls();
+
+    res = sock_dtls_add_credential(sock, init->dtls_cred->tag);
+    if (res < 0) {
+        DERR("cannot use credential: %d\n", res);
+        return res;
+    }
+
+#ifdef NET_DTLS_HOOK
+    /* Put the handshake accounting in front of gcoap's event handler. There
+     * is no getter for the handler, so the tinydtls sock is looked into. No
+     * handler means gcoap does not listen for events, so neither do we. */
+    if (sock->async_cb && sock->async_cb != _dtls_sock_cb) {
+        _dtls_gcoap_cb = sock->async_cb;
+        sock_dtls_set_cb(sock, _dtls_sock_cb, sock->async_cb_arg);
+    }
+#else
+    DWRN("no sock_async with tinydtls, handshakes are not counted\n");
+#endif
+#else
+    (void)init;
+#endif
     return 0;
 }
 
-int remstr_open(rem_res_t const *init)
+int remstr_open(rem_res_t const *init, net_hint_t *hint)
 {
     if (!init) return -EINVAL;
 
@@ -219,6 +409,7 @@ int remstr_open(rem_res_t const *init)
     privdata->pdu.hdr = (coap_hdr_t *) privdata->buf;
     privdata->number_of_bytes=0;
     privdata->err=0;
+    privdata->hint = hint;
 
     /* Init Block Object*/
     coap_block_object_init(&privdata->block1_init,0,LENGHT_OF_SEND_PAYLOAD,1);
@@ -269,31 +460,33 @@ static ssize_t _write(vfs_file_t *filp, const void *src, size_t nbytes)
 
     /* if send to server failed */
     if(privdata->err == 1){
-    	return -1;
+    	return privdata->busy ? -EBUSY : -EIO;
     }
     return nbytes;
 }
 
 
 
-int net_send(rem_res_t const *res, int fd){
+int net_send(rem_res_t const *res, int fd, net_hint_t *hint){
 
 	/* Buffer for read/write transfer*/
 	char snd_buff[LENGHT_OF_SEND_PAYLOAD];
 	int remfd, re;
 
+	if (hint) memset(hint, 0, sizeof(*hint));
+
 	vfs_lseek(fd, 0, SEEK_SET);
 
 	_print_payload(res, fd);
 
 	/* Bind file descriptor for CoAP networking*/
-	remfd = remstr_open(res);
+	remfd = remstr_open(res, hint);
 
 	/* Read from file and send to CoAP Remote Server*/
 	while ((re = vfs_read(fd, snd_buff, LENGHT_OF_SEND_PAYLOAD)) > 0) {
 		int const cnt = re;
 		re = vfs_write(remfd, snd_buff, cnt);
-		if (re == -1) break;
+		if (re < 0) break;
 	    }
 
 	/* Close file descriptor for CoAP networking*/
@@ -301,6 +494,204 @@ int net_send(rem_res_t const *res, int fd){
 	return re < 0 ? re : 0;
 }
 
+static unsigned _link_mtu(sock_udp_ep_t const *remote)
+{
+    gnrc_netif_t *netif = gnrc_netif_get_by_pid(remote->netif);
+    if (!netif || netif->ipv6.mtu == 0) return IPV6_MIN_MTU;
+    return netif->ipv6.mtu;
+}
+
+int net_send_unreliable(rem_res_t const *res, int fd)
+{
+    if (!res) return -EINVAL;
+
+    sock_udp_ep_t remote;
+    if (!_init_remote(&remote, res->address, res->port)) return -EDESTADDRREQ;
+
+    uint8_t *buf = malloc(CONFIG_GCOAP_PDU_BUF_SIZE);
+    if (!buf) return -ENOMEM;
+
+    coap_pkt_t pdu;
+    int retval = 0;
+
+    gcoap_req_init(&pdu, buf, CONFIG_GCOAP_PDU_BUF_SIZE, COAP_METHOD_PUT,
+                   res->res_location);
+    coap_hdr_set_type(pdu.hdr, COAP_TYPE_NON);
+    coap_opt_add_format(&pdu, COAP_FORMAT_SENML_CBOR);
+    ssize_t const hdr_len = coap_opt_finish(&pdu, COAP_OPT_FINISH_PAYLOAD);
+
+    /* The payload must fit in the PDU buffer, as well as in a datagram */
+    size_t room = pdu.payload_len;
+    size_t const mtu_room = _link_mtu(&remote) - IPV6_UDP_HDR_LEN
+                          - DTLS_RECORD_OVERHEAD - hdr_len;
+    if (mtu_room < room) room = mtu_room;
+
+    vfs_lseek(fd, 0, SEEK_SET);
+
+    size_t len = 0;
+    ssize_t re;
+    while (len < room &&
+           (re = vfs_read(fd, pdu.payload + len, room - len)) > 0) {
+        len += re;
+    }
+
+    uint8_t probe;
+    if (len == 0) {
+        DDBG("nothing to send\n");
+        goto _send_unreliable_end;
+    }
+    if (len == room && vfs_read(fd, &probe, 1) > 0) {
+        DDBG("does not fit in %u bytes\n", (unsigned)room);
+        retval = -EMSGSIZE;
+        goto _send_unreliable_end;
+    }
+
+    /* No response handler: gcoap neither keeps track of the request, nor
+     * waits for the response */
+    if (_req_send(buf, hdr_len + len, &remote, NULL, NULL) <= 0) {
+        DERR("send failed\n");
+        retval = -EIO;
+    }
+
+_send_unreliable_end:
+    free(buf);
+    return retval;
+}
+
+typedef struct net_recv_ctx {
+    uint8_t buf[CONFIG_GCOAP_PDU_BUF_SIZE];
+    uint8_t payload[LENGHT_OF_SEND_PAYLOAD];
+    size_t payload_len;
+    coap_block1_t block2;
+    int err;
+    bool done;
+    cond_t cond;
+    mutex_t lock;
+} net_recv_ctx_t;
+
+static void _recv_resp_handler(const gcoap_request_memo_t *memo, coap_pkt_t* pdu,
+                               const sock_udp_ep_t *remote)
+{
+    (void)remote;
+    net_recv_ctx_t *ctx = (net_recv_ctx_t *)memo->context;
+
+    if (memo->state == GCOAP_MEMO_TIMEOUT) {
+        DERR("timeout\n");
+        ctx->err = -ETIMEDOUT;
+        goto _recv_resp_end;
+    }
+    else if (memo->state == GCOAP_MEMO_ERR) {
+        DERR("error in response\n");
+        ctx->err = -EIO;
+        goto _recv_resp_end;
+    }
+
+    unsigned const code = coap_get_code_raw(pdu);
+    if (code != COAP_CODE_CONTENT) {
+        DERR("response code %u.%02u\n", code >> 5, code & 0x1f);
+        ctx->err = (code == COAP_CODE_SERVICE_UNAVAILABLE ||
+                    code == COAP_CODE_TOO_MANY_REQUESTS) ? -EBUSY : -EIO;
+        goto _recv_resp_end;
+    }
+
+    /* A resource that fits in one response comes without Block2 option */
+    if (!coap_get_block2(pdu, &ctx->block2)) {
+        ctx->block2.offset = 0;
+        ctx->block2.more = 0;
+    }
+
+    if (pdu->payload_len > sizeof(ctx->payload)) {
+        DERR("block too large: %u\n", (unsigned)pdu->payload_len);
+        ctx->err = -EMSGSIZE;
+        goto _recv_resp_end;
+    }
+
+    memcpy(ctx->payload, pdu->payload, pdu->payload_len);
+    ctx->payload_len = pdu->payload_len;
+
+_recv_resp_end:
+    mutex_lock(&ctx->lock);
+    ctx->done = true;
+    cond_signal(&ctx->cond);
+    mutex_unlock(&ctx->lock);
+}
+
+int net_recv(rem_res_t const *res, int fd)
+{
+    if (!res) return -EINVAL;
+
+    net_recv_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) return -ENOMEM;
+
+    sock_udp_ep_t remote;
+    if (!_init_remote(&remote, res->address, res->port)) {
+        free(ctx);
+        return -EDESTADDRREQ;
+    }
+
+    mutex_init(&ctx->lock);
+    cond_init(&ctx->cond);
+
+    int retval = 0;
+    size_t offset = 0;
+    unsigned szx = CDF_BLOCK_SIZE_EXP - 4;
+
+    do {
+        /* The server may answer with smaller blocks than requested, so we
+         * derive the next block number from the received offset. */
+        coap_block1_t block2;
+        coap_block_object_init(&block2, offset >> (szx + 4), 1 << (szx + 4), 0);
+
+        coap_pkt_t pdu;
+        gcoap_req_init(&pdu, ctx->buf, sizeof(ctx->buf), COAP_METHOD_GET,
+                       res->res_location);
+        coap_opt_add_block2_control(&pdu, &block2);
+        ssize_t const len = coap_opt_finish(&pdu, COAP_OPT_FINISH_NONE);
+
+        ctx->done = false;
+        ctx->err = 0;
+
+        mutex_lock(&ctx->lock);
+
+        if (_req_send(ctx->buf, len, &remote, _recv_resp_handler, ctx) <= 0) {
+            mutex_unlock(&ctx->lock);
+            DERR("send failed\n");
+            retval = -EIO;
+            break;
+        }
+
+        while (!ctx->done) cond_wait(&ctx->cond, &ctx->lock);
+
+        mutex_unlock(&ctx->lock);
+
+        if (ctx->err) {
+            retval = ctx->err;
+            break;
+        }
+
+        if (ctx->block2.offset != offset) {
+            DERR("unexpected block offset %u\n", (unsigned)ctx->block2.offset);
+            retval = -EIO;
+            break;
+        }
+
+        ssize_t const written = vfs_write(fd, ctx->payload, ctx->payload_len);
+        if (written != (ssize_t)ctx->payload_len) {
+            retval = written < 0 ? written : -ENOSPC;
+            break;
+        }
+
+        DDBG("block %u: %u bytes\n", (unsigned)ctx->block2.blknum,
+             (unsigned)ctx->payload_len);
+
+        offset += ctx->payload_len;
+        szx = ctx->block2.szx;
+    } while (ctx->block2.more);
+
+    free(ctx);
+    return retval;
+}
+
 static const vfs_file_ops_t network_impl = {
 	.close = _close,
     .write = _write
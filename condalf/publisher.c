@@ -15,104 +15,631 @@
 #include "thread.h"
 #include "cond.h"
 #include "networking.h"
+#include "senml_enc.h"
+#include "vstorage.h"
+#include "vfs.h"
+#include "mempress.h"
+#include "ztimer.h"
 #include <errno.h>
+#include <stdbool.h>
+#include <string.h>
 
 #define DLOG_LEVEL DLOG_INF
+#define DLOG_MODULE "publisher"
 #include "dlog.h"
 
+/* Marks the receive jobs in the queue. Above the TRANSJOBF_* range, so it cannot
+ * collide with the user flags. */
+#define PUBL_JOBF_RECV 0x100
+
+typedef struct publ_ep publ_ep_t;
+typedef struct publ publ_t;
+
+/* A server endpoint, shared by all the publishers sending to it */
+struct publ_ep {
+    publ_ep_t *next;
+    char *address;
+    uint16_t port;
+    unsigned refcnt;
+    unsigned inflight;      /**< # transfers currently executed */
+    unsigned max_inflight;
+};
+
+/* Queued job, with the length of its data measured before taking _lock */
 typedef struct {
+    transfer_job_t *job;
+    ssize_t len;
+} publ_qent_t;
+
+struct publ {
     transdrv_t driv;
+    publ_t *next;
+    publ_ep_t *ep;
     rem_res_t rem_res;
-    uint32_t nb_jobs_snd; /**< # sending jobs */
+    /* Job queue, protected by _lock */
+    publ_qent_t *queue;
+    size_t queue_len;
+    size_t queue_ri;
+    size_t queue_fill;
+    uint32_t nb_jobs_snd; /**< # sending jobs, protected by _lock */
     cond_t close_cond;
     mutex_t lock;
     unsigned retry_cnt;
-} publ_t;
+    int flags;
+    size_t coalesce_len;
+    publ_stats_t stats;
+    /* Flow control requested by the server, see net_hint_t. Times are
+     * ZTIMER_SEC timestamps. */
+    uint32_t holdoff_until; /**< no transfer before this time */
+    uint32_t min_interval;  /**< seconds between transfer starts */
+    uint32_t pacing_until;  /**< min_interval applies until this time */
+    uint32_t last_start;    /**< start of the last transfer */
+};
 
 static transdrv_itf_t const sender_impl;
 
-static kernel_pid_t _sender_pid = KERNEL_PID_UNDEF;
-#define PUBLISHER_QUEUE_MSGQUEUE_LEN 4
+/* Protects the publisher and endpoint lists, as well as the job queues */
+static mutex_t      _lock = MUTEX_INIT;
+/* Signaled whenever a job might have become eligible for execution */
+static cond_t       _work_cond;
+static publ_t       *_publ_lhead = NULL;
+static publ_t       *_publ_rr = NULL; /**< next publisher to serve */
+static publ_ep_t    *_ep_lhead = NULL;
+static unsigned     _nb_workers = 0; /**< worker threads started */
+/* Wakes the workers once a paced publisher may transfer again */
+static ztimer_t     _pace_timer;
+static uint32_t     _pace_wake; /**< ZTIMER_SEC time _pace_timer fires */
+
+/* Returns how many seconds to wait before the next transfer may start. */
+static uint32_t _pub_pace_delay(publ_t *snd)
+{
+    uint32_t const now = ztimer_now(ZTIMER_SEC);
+    int32_t delay = 0;
+
+    mutex_lock(&snd->lock);
+
+    int32_t const holdoff = (int32_t)(snd->holdoff_until - now);
+    int32_t const interval = (int32_t)(snd->last_start + snd->min_interval - now);
+
+    if (holdoff > delay) delay = holdoff;
+    if ((int32_t)(snd->pacing_until - now) > 0 && interval > delay) {
+        delay = interval;
+    }
+
+    mutex_unlock(&snd->lock);
+
+    return delay;
+}
+
+static int _pub_net_send(publ_t *snd, int fd)
+{
+    net_hint_t hint;
+    uint32_t const start = ztimer_now(ZTIMER_SEC);
+
+    int res = net_send(&snd->rem_res, fd, &hint);
+
+    mutex_lock(&snd->lock);
+
+    snd->last_start = start;
+    /* Keep the pacing of earlier responses, a response or timeout without the
+     * hint doesn't mean the server lifted it */
+    if (hint.min_interval) {
+        snd->min_interval = hint.min_interval;
+        snd->pacing_until = ztimer_now(ZTIMER_SEC) + PUBLISHER_PACING_HOLD;
+    }
+    if (hint.retry_after) {
+        snd->holdoff_until = ztimer_now(ZTIMER_SEC) + hint.retry_after;
+    }
+
+    mutex_unlock(&snd->lock);
+
+    return res;
+}
+
+/* Returns -EMSGSIZE if the job must be sent reliably instead */
+static int _pub_send_unreliable(publ_t *snd, transfer_job_t *job)
+{
+    uint32_t const start = ztimer_now(ZTIMER_SEC);
+    int res = net_send_unreliable(&snd->rem_res, job->fd);
+
+    mutex_lock(&snd->lock);
+    if (res == -EMSGSIZE) snd->stats.nb_oversized++;
+    else snd->last_start = start;
+    if (res == 0) snd->stats.nb_unacked++;
+    mutex_unlock(&snd->lock);
+
+    if (res == -EMSGSIZE) DINF("too large, sending reliably\n");
+    if (res < 0 && res != -EMSGSIZE) DERR("failed: %d\n", res);
+
+    return res;
+}
+
+static bool _pub_job_unreliable(publ_t *snd, transfer_job_t *job)
+{
+    return (job->flags & TRANSJOBF_UNRELIABLE) || (snd->flags & PUBLF_UNRELIABLE);
+}
+
+static void _pub_count(publ_t *snd, int res)
+{
+    mutex_lock(&snd->lock);
+    if (res < 0) snd->stats.nb_failed++;
+    else snd->stats.nb_sent++;
+    mutex_unlock(&snd->lock);
+}
 
-static void _pub_exec_snd_job(transfer_job_t *job)
+/* Neither the workers nor the callers of the synchronous functions wait for as
+ * long as the server wishes. The job is tried again once _pub_pace_delay()
+ * passed. */
+static bool _pub_paced(publ_t *snd)
 {
-    if (!job) return;
-    publ_t *snd = (publ_t *)job->_drv_priv;
+    if (!_pub_pace_delay(snd)) return false;
+
+    DINF("paced by server, try again later\n");
+    return true;
+}
+
+/* Returns -EAGAIN if the server paces the publisher */
+static int _pub_exec_snd_job(publ_t *snd, transfer_job_t *job)
+{
+    int res;
+    unsigned retry = snd->retry_cnt;
+
+    if (_pub_paced(snd)) return -EAGAIN;
+
+    if (_pub_job_unreliable(snd, job)) {
+        res = _pub_send_unreliable(snd, job);
+        if (res != -EMSGSIZE) return res;
+    }
+
+    do {
+        if (_pub_paced(snd)) return -EAGAIN;
+
+        res = _pub_net_send(snd, job->fd);
+        if (res < 0 && retry) DWRN("failed: %d, retrying...\n", res);
+    } while (res < 0 && retry--);
+
+    /* Refused by the server, e.g. with 5.03 */
+    if (res < 0 && _pub_paced(snd)) return -EAGAIN;
+
+    if (res < 0) DERR("failed: %d\n", res);
+    _pub_count(snd, res);
+
+    return res > 0 ? 0 : res;
+}
 
+/* Returns -EAGAIN if the server paces the publisher */
+static int _pub_exec_rcv_job(publ_t *snd, transfer_job_t *job)
+{
     int res;
     unsigned retry = snd->retry_cnt;
 
     do {
-        res = net_send(&snd->rem_res, job->fd);
-        if (res < 0 && retry) { DWRN("failed: %d, retrying...\n", res) };
+        if (_pub_paced(snd)) return -EAGAIN;
+
+        /* Start over, a failed attempt may have written partial data */
+        vfs_lseek(job->fd, 0, SEEK_SET);
+        res = net_recv(&snd->rem_res, job->fd);
+        if (res < 0 && retry) DWRN("failed: %d, retrying...\n", res);
     } while (res < 0 && retry--);
 
-    if (res < 0) { DERR("failed: %d\n", res) };
+    if (res < 0 && _pub_paced(snd)) return -EAGAIN;
+
+    mutex_lock(&snd->lock);
+    if (res < 0) snd->stats.nb_failed++;
+    else snd->stats.nb_received++;
+    mutex_unlock(&snd->lock);
+
+    if (res < 0) DERR("failed: %d\n", res);
+
+    return res;
+}
+
+static ssize_t _pub_job_len(transfer_job_t *job)
+{
+    return vfs_lseek(job->fd, 0, SEEK_END);
+}
+
+/* Merge the SenML packs of several jobs into a single one. Returns the file
+ * descriptor of the merged pack, negative error otherwise. */
+static int _pub_merge(transfer_job_t **batch, size_t nb)
+{
+    senml_pack_hdr_t hdrs[PUBLISHER_COALESCE_JOBS_MAX];
+    ssize_t lens[PUBLISHER_COALESCE_JOBS_MAX];
+    uint8_t peek[SENML_PACK_HDR_MAXLEN + 2];
+    size_t cnt = 0;
+    size_t body_len = 0;
+
+    for (size_t i = 0; i < nb; i++) {
+        lens[i] = _pub_job_len(batch[i]);
+        if (lens[i] < 0) return lens[i];
+
+        vfs_lseek(batch[i]->fd, 0, SEEK_SET);
+        ssize_t res = vfs_read(batch[i]->fd, peek, sizeof(peek));
+        if (res < 0) return res;
+
+        res = senml_pack_hdr_parse(peek, res, &hdrs[i]);
+        if (res < 0) return res;
+
+        cnt += hdrs[i].cnt;
+        body_len += lens[i] - hdrs[i].hdr_len;
+
+        if (i && !hdrs[i].has_bn) {
+            cnt++;
+            body_len += SENML_PACK_BN_RESET_LEN;
+        }
+    }
+
+    char *buf = malloc(SENML_PACK_HDR_MAXLEN + body_len);
+    if (!buf) return -ENOMEM;
+
+    size_t len = senml_pack_hdr_put(buf, cnt);
+
+    for (size_t i = 0; i < nb; i++) {
+        if (i && !hdrs[i].has_bn) len += senml_pack_bn_reset(buf + len);
+
+        size_t const rec_len = lens[i] - hdrs[i].hdr_len;
+
+        vfs_lseek(batch[i]->fd, hdrs[i].hdr_len, SEEK_SET);
+        if (vfs_read(batch[i]->fd, buf + len, rec_len) != (ssize_t)rec_len) {
+            free(buf);
+            return -EIO;
+        }
+        len += rec_len;
+    }
+
+    vstorfile_init_t vf_init = {
+        .buf    = buf,
+        .bufsiz = len,
+        .flags  = VSTORF_OWNS_BUF | VSTORF_BUF_HAS_DATA
+    };
+
+    int fd = vstorfile_open(&vf_init);
+    if (fd < 0) free(buf);
+
+    return fd;
+}
+
+/* Returns the number of jobs executed from the start of the batch. The others
+ * are paced by the server and must be queued again. */
+static size_t _pub_exec_batch(publ_t *snd, transfer_job_t **batch, size_t nb)
+{
+    if (batch[0]->flags & PUBL_JOBF_RECV) {
+        int res = _pub_exec_rcv_job(snd, batch[0]);
+        if (res == -EAGAIN) return 0;
+
+        batch[0]->flags &= ~PUBL_JOBF_RECV;
+        if (batch[0]->cb) batch[0]->cb(batch[0], res);
+        return 1;
+    }
+
+    int fd = -1;
+    if (nb > 1) {
+        /* Merging needs a buffer for all the packs */
+        fd = mempress_high() ? -ENOMEM : _pub_merge(batch, nb);
+    }
+
+    if (fd < 0) {
+        if (nb > 1) DWRN("cannot merge %u packs: %d\n", (unsigned)nb, fd);
+
+        for (size_t i = 0; i < nb; i++) {
+            int res = _pub_exec_snd_job(snd, batch[i]);
+            if (res == -EAGAIN) return i;
+            if (batch[i]->cb) batch[i]->cb(batch[i], res);
+        }
+        return nb;
+    }
+
+    DINF("sending %u packs at once\n", (unsigned)nb);
+
+    transfer_job_t merged = {
+        .fd = fd,
+        .flags = batch[0]->flags
+    };
+
+    int res = _pub_exec_snd_job(snd, &merged);
+    vfs_close(fd);
+    if (res == -EAGAIN) return 0;
+
+    for (size_t i = 0; i < nb; i++) {
+        if (batch[i]->cb) batch[i]->cb(batch[i], res);
+    }
+
+    return nb;
+}
+
+/* Put jobs paced by the server back to the head of the queue, in their order.
+ * The queue has room for them, see _pub_enqueue(). Must be called with _lock
+ * held. */
+static void _pub_requeue(publ_t *snd, transfer_job_t **jobs, ssize_t const *lens,
+                         size_t nb)
+{
+    while (nb--) {
+        snd->queue_ri = (snd->queue_ri + snd->queue_len - 1) % snd->queue_len;
+        snd->queue[snd->queue_ri].job = jobs[nb];
+        snd->queue[snd->queue_ri].len = lens[nb];
+        snd->queue_fill++;
+    }
+}
+
+/* Must be called with _lock held */
+static transfer_job_t *_pub_pop(publ_t *snd, ssize_t *len)
+{
+    publ_qent_t const *ent = &snd->queue[snd->queue_ri];
+    snd->queue_ri = (snd->queue_ri + 1) % snd->queue_len;
+    snd->queue_fill--;
+
+    *len = ent->len;
+    return ent->job;
+}
+
+/* Whether a job of the publisher may be executed now. Paced publishers are
+ * skipped, \p wait is lowered to the delay of the first one to go on. Must be
+ * called with _lock held. */
+static bool _pub_ready(publ_t *snd, uint32_t *wait)
+{
+    if (!snd->queue_fill || snd->ep->inflight >= snd->ep->max_inflight) {
+        return false;
+    }
+
+    uint32_t const delay = _pub_pace_delay(snd);
+    if (delay) {
+        if (!*wait || delay < *wait) *wait = delay;
+        return false;
+    }
+
+    return true;
+}
+
+/* Pick the next job to execute, round-robin over the publishers. Must be called
+ * with _lock held. \p wait is set to the seconds until a paced publisher may go
+ * on, 0 if none. \p len is set to the length of the job's data. */
+static transfer_job_t *_pub_next_job(uint32_t *wait, ssize_t *len)
+{
+    *wait = 0;
+
+    /* Urgent jobs first, they are always at the head of their queue */
+    for (publ_t *snd = _publ_lhead; snd; snd = snd->next) {
+        if (snd->queue_fill &&
+            (snd->queue[snd->queue_ri].job->flags & TRANSJOBF_URGENT) &&
+            _pub_ready(snd, wait)) {
+            return _pub_pop(snd, len);
+        }
+    }
+
+    publ_t *snd = _publ_rr ? _publ_rr : _publ_lhead;
+
+    for (publ_t *first = snd; snd; ) {
+        if (_pub_ready(snd, wait)) {
+            _publ_rr = snd->next;
+            return _pub_pop(snd, len);
+        }
+
+        snd = snd->next ? snd->next : _publ_lhead;
+        if (snd == first) break;
+    }
+
+    return NULL;
+}
+
+/* Take the queued jobs following batch[0] that can be sent along with it. Must
+ * be called with _lock held. Returns the number of jobs in the batch. */
+static size_t _pub_coalesce(publ_t *snd, transfer_job_t **batch, ssize_t *lens)
+{
+    size_t nb = 1;
+
+    if (!snd->coalesce_len || (batch[0]->flags & PUBL_JOBF_RECV)) return nb;
+
+    ssize_t total = lens[0];
+    if (total < 0) return nb;
+
+    while (snd->queue_fill && nb < PUBLISHER_COALESCE_JOBS_MAX) {
+        publ_qent_t const *ent = &snd->queue[snd->queue_ri];
+        if (ent->job->flags != batch[0]->flags) break;
+
+        if (ent->len < 0) break;
+        if ((size_t)(total + ent->len + SENML_PACK_BN_RESET_LEN) > snd->coalesce_len) break;
+
+        total += ent->len + SENML_PACK_BN_RESET_LEN;
+        batch[nb] = _pub_pop(snd, &lens[nb]);
+        nb++;
+    }
+
+    return nb;
+}
+
+static void _pub_pace_cb(void *arg)
+{
+    (void)arg;
+    cond_broadcast(&_work_cond);
+}
+
+/* Wake the workers after \p delay seconds, unless an earlier wake up is set.
+ * Must be called with _lock held. */
+static void _pub_arm_pace(uint32_t delay)
+{
+    uint32_t const wake = ztimer_now(ZTIMER_SEC) + delay;
+
+    if (ztimer_is_set(ZTIMER_SEC, &_pace_timer) &&
+        (int32_t)(wake - _pace_wake) >= 0) {
+        return;
+    }
 
-    if (job->cb) job->cb(job, res > 0 ? 0 : res);
+    _pace_wake = wake;
+    ztimer_set(ZTIMER_SEC, &_pace_timer, delay);
 }
 
-static void *_pub_thread(void *arg)
+static void *_pub_worker(void *arg)
 {
-    static msg_t msg_queue[PUBLISHER_QUEUE_MSGQUEUE_LEN];
-    msg_t msg;
-    msg_init_queue(msg_queue, PUBLISHER_QUEUE_MSGQUEUE_LEN);
+    (void)arg;
+
+    transfer_job_t *batch[PUBLISHER_COALESCE_JOBS_MAX];
+    ssize_t lens[PUBLISHER_COALESCE_JOBS_MAX];
+
+    mutex_lock(&_lock);
 
     while (1) {
-        msg_receive(&msg);
-        publ_t *snd = (publ_t *)((transfer_job_t *)msg.content.ptr)->_drv_priv;
+        uint32_t wait;
+        batch[0] = _pub_next_job(&wait, &lens[0]);
+        if (!batch[0]) {
+            /* A paced publisher must not hold a worker, wait for any of
+             * them instead */
+            if (wait) _pub_arm_pace(wait);
+            cond_wait(&_work_cond, &_lock);
+            continue;
+        }
+
+        publ_t *snd = (publ_t *)batch[0]->_drv_priv;
+        size_t const nb = _pub_coalesce(snd, batch, lens);
+        snd->ep->inflight++;
+
+        mutex_unlock(&_lock);
+        size_t const done = _pub_exec_batch(snd, batch, nb);
+        mutex_lock(&_lock);
+
+        _pub_requeue(snd, batch + done, lens + done, nb - done);
 
-        _pub_exec_snd_job((transfer_job_t *)msg.content.ptr);
+        snd->ep->inflight--;
+        /* Jobs blocked by the endpoint limit may run now */
+        cond_broadcast(&_work_cond);
 
-        mutex_lock(&snd->lock);
-        if (--snd->nb_jobs_snd == 0) cond_signal(&snd->close_cond);
-        mutex_unlock(&snd->lock);
+        snd->nb_jobs_snd -= done;
+        if (snd->nb_jobs_snd == 0) cond_signal(&snd->close_cond);
     }
 
     return NULL;
 }
 
+/* Starts the workers not running yet, so a failed start is retried on the
+ * unused stacks only. Must be called with _lock held. */
 static int _pub_init_subsys(void)
 {
-    static char sender_stack[THREAD_STACKSIZE_MAIN];
+    static char worker_stacks[PUBLISHER_NB_WORKERS][PUBLISHER_WORKER_STACKSIZE];
 
-    _sender_pid = thread_create(
-        sender_stack,
-        sizeof(sender_stack),
-        PUBLISHER_QUEUE_PRIO,
-        0,
-        _pub_thread,
-        NULL,
-        "sender");
+    if (_nb_workers == 0) {
+        cond_init(&_work_cond);
+        _pace_timer.callback = _pub_pace_cb;
+    }
+
+    while (_nb_workers < PUBLISHER_NB_WORKERS) {
+        kernel_pid_t pid = thread_create(
+            worker_stacks[_nb_workers],
+            sizeof(worker_stacks[_nb_workers]),
+            PUBLISHER_QUEUE_PRIO,
+            0,
+            _pub_worker,
+            NULL,
+            "sender");
 
-    if (_sender_pid < 0) {
-        return _sender_pid;
+        if (pid < 0) return pid;
+
+        _nb_workers++;
     }
 
     return 0;
 }
 
-int publisher_init(transdrv_t **drvpp, rem_res_t const *rem_res, unsigned retry_cnt)
+/* Must be called with _lock held */
+static publ_ep_t *_pub_get_ep(rem_res_t const *rem_res, unsigned max_inflight)
 {
-    int res;
+    publ_ep_t *ep;
+
+    if (!max_inflight) max_inflight = 1;
+
+    for (ep = _ep_lhead; ep; ep = ep->next) {
+        if (ep->port == rem_res->port && !strcmp(ep->address, rem_res->address)) {
+            ep->refcnt++;
+            if (max_inflight > ep->max_inflight) {
+                ep->max_inflight = max_inflight;
+                /* Jobs blocked by the endpoint limit may run now */
+                cond_broadcast(&_work_cond);
+            }
+            return ep;
+        }
+    }
+
+    ep = calloc(1, sizeof(*ep));
+    if (!ep) return NULL;
 
-    if (_sender_pid == KERNEL_PID_UNDEF) {
-        res = _pub_init_subsys();
-        if (res) return res;
+    ep->address = strdup(rem_res->address);
+    if (!ep->address) {
+        free(ep);
+        return NULL;
+    }
+
+    ep->port = rem_res->port;
+    ep->refcnt = 1;
+    ep->max_inflight = max_inflight;
+
+    ep->next = _ep_lhead;
+    _ep_lhead = ep;
+
+    return ep;
+}
+
+/* Must be called with _lock held */
+static void _pub_put_ep(publ_ep_t *ep)
+{
+    if (--ep->refcnt) return;
+
+    publ_ep_t **epp = &_ep_lhead;
+    while (*epp != ep) epp = &(*epp)->next;
+    *epp = ep->next;
+
+    free(ep->address);
+    free(ep);
+}
+
+int publisher_create(transdrv_t **drvpp, publ_init_t const *init)
+{
+    if (!drvpp || !init || !init->rem_res) return -EINVAL;
+
+    mutex_lock(&_lock);
+    int res = _pub_init_subsys();
+    unsigned const nb_workers = _nb_workers;
+    mutex_unlock(&_lock);
+
+    if (res) {
+        DERR("started %u of %u workers: %d\n", nb_workers,
+            PUBLISHER_NB_WORKERS, res);
+        /* A missing worker is started on the next creation */
+        if (!nb_workers) return res;
     }
 
     publ_t *snd = calloc(1, sizeof(*snd));
     if (!snd) return -ENOMEM;
 
-    res = rem_res_cpy(&snd->rem_res, rem_res);
+    res = rem_res_cpy(&snd->rem_res, init->rem_res);
     if (res) goto sender_init_err;
 
+    snd->queue_len = init->queue_len ? init->queue_len : PUBLISHER_QUEUE_LEN;
+    snd->queue = calloc(snd->queue_len, sizeof(*snd->queue));
+    if (!snd->queue) {
+        res = -ENOMEM;
+        goto sender_init_err;
+    }
+
     snd->driv.itf = &sender_impl;
-    snd->retry_cnt = retry_cnt;
+    snd->retry_cnt = init->retry_cnt;
+    snd->flags = init->flags;
+    snd->coalesce_len = init->coalesce_len;
 
     mutex_init(&snd->lock);
     cond_init(&snd->close_cond);
 
+    mutex_lock(&_lock);
+
+    snd->ep = _pub_get_ep(&snd->rem_res, init->max_inflight);
+    if (!snd->ep) {
+        mutex_unlock(&_lock);
+        res = -ENOMEM;
+        goto sender_init_err;
+    }
+
+    snd->next = _publ_lhead;
+    _publ_lhead = snd;
+
+    mutex_unlock(&_lock);
+
     *drvpp = (transdrv_t *)snd;
 
     return 0;
@@ -120,63 +647,150 @@ int publisher_init(transdrv_t **drvpp, rem_res_t const *rem_res, unsigned retry_
 sender_init_err:
     if (snd) {
         rem_res_freedata(&snd->rem_res);
+        free(snd->queue);
         free(snd);
     }
 
     return res;
 }
 
-static int _pub_try_send(transdrv_t *drv, transfer_job_t *job)
+int publisher_init(transdrv_t **drvpp, rem_res_t const *rem_res, unsigned retry_cnt)
 {
-    publ_t *snd = (publ_t *)drv;
+    publ_init_t const init = {
+        .rem_res = rem_res,
+        .retry_cnt = retry_cnt
+    };
 
-    job->_drv_priv = snd;
+    return publisher_create(drvpp, &init);
+}
 
-    msg_t msg = {
-        .content.ptr = job
-    };
+int publisher_get_stats(transdrv_t *drv, publ_stats_t *stats)
+{
+    if (!drv || !stats) return -EINVAL;
+
+    publ_t *snd = (publ_t *)drv;
 
     mutex_lock(&snd->lock);
+    *stats = snd->stats;
+    mutex_unlock(&snd->lock);
 
-    snd->nb_jobs_snd++;
+    return 0;
+}
+
+static int _pub_enqueue(publ_t *snd, transfer_job_t *job)
+{
+    job->_drv_priv = snd;
+
+    /* Measured for the coalescing, which must not seek under _lock */
+    ssize_t const len = (snd->coalesce_len && !(job->flags & PUBL_JOBF_RECV)) ?
+                        _pub_job_len(job) : -1;
 
-    int res = msg_try_send(&msg, _sender_pid);
+    mutex_lock(&_lock);
+
+    /* The jobs being executed keep their slots, to be queued again if the
+     * server paces the publisher */
+    if (snd->nb_jobs_snd == snd->queue_len) {
+        mutex_unlock(&_lock);
+        DERR("sender queue full!\n");
+        return -EWOULDBLOCK;
+    }
 
-    if (res != 1) {
-        if (--snd->nb_jobs_snd == 0) cond_signal(&snd->close_cond);
+    if (job->flags & TRANSJOBF_URGENT) {
+        /* Jump the queue, but behind the urgent jobs queued before. These move
+         * one slot to the front. */
+        size_t const qlen = snd->queue_len;
+        size_t i = snd->queue_ri = (snd->queue_ri + qlen - 1) % qlen;
 
-        mutex_unlock(&snd->lock);
+        for (size_t n = 0; n < snd->queue_fill; n++) {
+            size_t const next = (i + 1) % qlen;
+            if (!(snd->queue[next].job->flags & TRANSJOBF_URGENT)) break;
 
-        if (res == 0) {
-            DERR("sender queue full!\n")
-            return -EWOULDBLOCK;
-        } else {
-            return -ESRCH;
+            snd->queue[i] = snd->queue[next];
+            i = next;
         }
+
+        snd->queue[i].job = job;
+        snd->queue[i].len = len;
+    } else {
+        size_t const wi = (snd->queue_ri + snd->queue_fill) % snd->queue_len;
+        snd->queue[wi].job = job;
+        snd->queue[wi].len = len;
     }
+    snd->queue_fill++;
+    snd->nb_jobs_snd++;
 
-    mutex_unlock(&snd->lock);
+    /* Synchronous transfers wait on the condition as well */
+    cond_broadcast(&_work_cond);
+
+    mutex_unlock(&_lock);
 
     return 0;
 }
 
+static int _pub_try_send(transdrv_t *drv, transfer_job_t *job)
+{
+    job->flags &= ~PUBL_JOBF_RECV;
+    return _pub_enqueue((publ_t *)drv, job);
+}
+
+static int _pub_try_recv(transdrv_t *drv, transfer_job_t *job)
+{
+    job->flags |= PUBL_JOBF_RECV;
+    int res = _pub_enqueue((publ_t *)drv, job);
+    if (res) job->flags &= ~PUBL_JOBF_RECV;
+    return res;
+}
+
+/* Take an inflight slot of the endpoint for a synchronous transfer, they count
+ * against publ_init_t::max_inflight like the ones of the workers */
+static void _pub_ep_take(publ_ep_t *ep)
+{
+    mutex_lock(&_lock);
+    while (ep->inflight >= ep->max_inflight) cond_wait(&_work_cond, &_lock);
+    ep->inflight++;
+    mutex_unlock(&_lock);
+}
+
+static void _pub_ep_release(publ_ep_t *ep)
+{
+    mutex_lock(&_lock);
+    ep->inflight--;
+    /* Jobs blocked by the endpoint limit may run now */
+    cond_broadcast(&_work_cond);
+    mutex_unlock(&_lock);
+}
+
 static int _pub_send(transdrv_t *drv, transfer_job_t *job)
 {
     publ_t *snd = (publ_t *)drv;
 
-    int res;
-    unsigned retry = snd->retry_cnt;
+    _pub_ep_take(snd->ep);
+    int res = _pub_exec_snd_job(snd, job);
+    _pub_ep_release(snd->ep);
 
-    do {
-        res = net_send(&snd->rem_res, job->fd);
-        if (res < 0 && retry) { DWRN("failed: %d, retrying...\n", res) };
-    } while (res < 0 && retry--);
+    if (res == 0 && job->cb) job->cb(job, 0);
 
-    if (res < 0) { DERR("failed: %d\n", res) };
+    return res;
+}
 
-    if (res >= 0 && job->cb) job->cb(job, res);
+static uint32_t _pub_holdoff(transdrv_t *drv)
+{
+    return _pub_pace_delay((publ_t *)drv);
+}
 
-    return res > 0 ? 0 : res;
+static int _pub_recv(transdrv_t *drv, transfer_job_t *job)
+{
+    publ_t *snd = (publ_t *)drv;
+
+    _pub_ep_take(snd->ep);
+    int res = _pub_exec_rcv_job(snd, job);
+    _pub_ep_release(snd->ep);
+
+    if (res < 0) return res;
+
+    if (job->cb) job->cb(job, 0);
+
+    return 0;
 }
 
 static void _pub_delete(transdrv_t **drv)
@@ -184,20 +798,33 @@ static void _pub_delete(transdrv_t **drv)
     publ_t **sndpp = (publ_t **)drv;
     publ_t *sndp = *sndpp;
 
+    mutex_lock(&_lock);
+
     /* Wait for the enqueued jobs to finish... */
-    mutex_lock(&sndp->lock);
-    while (sndp->nb_jobs_snd) cond_wait(&sndp->close_cond, &sndp->lock);
-    mutex_unlock(&sndp->lock);
+    while (sndp->nb_jobs_snd) cond_wait(&sndp->close_cond, &_lock);
+
+    publ_t **pp = &_publ_lhead;
+    while (*pp != sndp) pp = &(*pp)->next;
+    *pp = sndp->next;
+    if (_publ_rr == sndp) _publ_rr = sndp->next;
+
+    _pub_put_ep(sndp->ep);
+
+    mutex_unlock(&_lock);
 
     rem_res_freedata(&sndp->rem_res);
+    free(sndp->queue);
     free(sndp);
     *sndpp = NULL;
 }
 
 static transdrv_itf_t const sender_impl = {
     .trysend = _pub_try_send,
+    .tryrecv = _pub_try_recv,
     .send    = _pub_send,
-    .delete  = _pub_delete
+    .recv    = _pub_recv,
+    .delete  = _pub_delete,
+    .holdoff = _pub_holdoff
 };
 
 #endif /* CONDALF_USE_PUBLISHER == 1 */
@@ -9,12 +9,24 @@
 #if CONDALF_USE_RDLOG == 1
 
 #include "errno.h"
+#include "irq.h"
 #include "mutex.h"
 #include "logging.h"
+#include "mempress.h"
+#include "msg.h"
+#include "slotring.h"
+#include "thread.h"
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include "ztimer.h"
 
 #define DLOG_LEVEL DLOG_ERR
+#define DLOG_MODULE "rdlog"
 #include "rdlog.h"
 
 #define RDLOG_ENC_BUF_LEN (RDLOG_REC_QUEUE_LEN * RDLOG_LOG_MAXLEN)
@@ -23,9 +35,187 @@ mutex_t _lock = MUTEX_INIT;
 recstr_t *_logger = NULL;
 timex_t (*_timef)(void) = NULL;
 
-void _rdlog(unsigned level, char const *fmt, ...)
+#if RDLOG_BINARY == 1
+/* Binary log encoding: the address of the format string, then the arguments,
+ * in the order of the conversions. Integers are LEB128 varints, the signed ones
+ * zigzag-mapped first, doubles 8 Bytes little endian, and strings a varint
+ * length followed by the characters. tools/rdlog_decode.py reverses this. */
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t pos;
+} rdlog_bin_t;
+
+static bool _rdlog_bin_uint(rdlog_bin_t *b, uint64_t val)
+{
+    size_t n = 1;
+    for (uint64_t v = val >> 7; v; v >>= 7) n++;
+    if (b->len - b->pos < n) return false;
+
+    do {
+        uint8_t const byte = val & 0x7f;
+        val >>= 7;
+        b->buf[b->pos++] = byte | (val ? 0x80 : 0);
+    } while (val);
+
+    return true;
+}
+
+static bool _rdlog_bin_int(rdlog_bin_t *b, int64_t val)
+{
+    return _rdlog_bin_uint(b, ((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+}
+
+static bool _rdlog_bin_double(rdlog_bin_t *b, double val)
+{
+    if (b->len - b->pos < 8) return false;
+
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    for (unsigned i = 0; i < 8; i++) b->buf[b->pos++] = bits >> (8 * i);
+
+    return true;
+}
+
+static bool _rdlog_bin_str(rdlog_bin_t *b, char const *str)
+{
+    if (!str) str = "(null)";
+
+    /* Cut to what's left, the length takes one Byte then */
+    size_t len = strlen(str);
+    if (len > 127 || b->len - b->pos < len + 1) {
+        if (b->len - b->pos < 2) return false;
+        len = b->len - b->pos - 1;
+        if (len > 127) len = 127;
+    }
+
+    _rdlog_bin_uint(b, len);
+    memcpy(&b->buf[b->pos], str, len);
+    b->pos += len;
+
+    return true;
+}
+
+/* Walks the conversions of the format string, and encodes the arguments
+ * until the buffer is full. */
+static size_t _rdlog_bin(uint8_t *buf, size_t len, char const *fmt, va_list args)
+{
+    rdlog_bin_t b = { .buf = buf, .len = len };
+
+    if (!_rdlog_bin_uint(&b, (uintptr_t)fmt)) return 0;
+
+    for (char const *c = fmt; *c; c++) {
+        if (*c != '%') continue;
+        if (*++c == '%') continue;
+        if (!*c) break;
+
+        while (*c && strchr("-+ #0", *c)) c++;
+
+        /* width, then precision */
+        for (unsigned i = 0; i < 2; i++) {
+            if (i == 1) {
+                if (*c != '.') break;
+                c++;
+            }
+            if (*c == '*') {
+                if (!_rdlog_bin_int(&b, va_arg(args, int))) return b.pos;
+                c++;
+            }
+            while (*c >= '0' && *c <= '9') c++;
+        }
+
+        /* length */
+        unsigned lng = 0;
+        bool size = false;
+        while (*c && strchr("hlLjzt", *c)) {
+            if (*c == 'l' || *c == 'L') lng++;
+            if (*c == 'j') lng = 2;
+            if (*c == 'z' || *c == 't') size = true;
+            c++;
+        }
+
+        bool ok;
+        switch (*c) {
+        case 'd':
+        case 'i':
+            ok = _rdlog_bin_int(&b,
+                size     ? (int64_t)va_arg(args, ptrdiff_t) :
+                lng >= 2 ? (int64_t)va_arg(args, long long) :
+                lng == 1 ? (int64_t)va_arg(args, long) :
+                           (int64_t)va_arg(args, int));
+            break;
+
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        case 'c':
+            ok = _rdlog_bin_uint(&b,
+                size     ? (uint64_t)va_arg(args, size_t) :
+                lng >= 2 ? (uint64_t)va_arg(args, unsigned long long) :
+                lng == 1 ? (uint64_t)va_arg(args, unsigned long) :
+                           (uint64_t)va_arg(args, unsigned));
+            break;
+
+        case 'p':
+            ok = _rdlog_bin_uint(&b, (uintptr_t)va_arg(args, void *));
+            break;
+
+        case 's':
+            ok = _rdlog_bin_str(&b, va_arg(args, char const *));
+            break;
+
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            ok = _rdlog_bin_double(&b, lng ? (double)va_arg(args, long double) :
+                                             va_arg(args, double));
+            break;
+
+        default:
+            /* %n or not a conversion, the arguments can't be followed */
+            ok = false;
+            break;
+        }
+
+        if (!ok) break;
+    }
+
+    return b.pos;
+}
+#endif
+
+/* Sites with suppressed messages, not reported yet */
+static rdlog_site_t *_suppressed = NULL;
+
+/* The messages are formatted into the slots of a static ring, and passed to
+ * the logger by the drain thread, see \ref slotring.h. No heap, no mutex on
+ * the producer side. */
+typedef struct {
+    slotring_slot_t hdr;
+    uint8_t level;
+    uint16_t len;
+    timex_t timestamp;
+    char buf[RDLOG_LOG_MAXLEN];
+} rdlog_slot_t;
+
+#define RDLOG_MSG_WAKEUP    0
+#define RDLOG_MSG_SYNC      1
+
+static rdlog_slot_t _slots[RDLOG_RING_LEN];
+static slotring_t   _ring = SLOTRING_INIT(_slots);
+
+static kernel_pid_t _drain_pid = KERNEL_PID_UNDEF;
+
+/* Builds the record of a formatted message, with a heap copy of the message */
+static int _rdlog_record(record_t *rec, unsigned level, timex_t timestamp,
+                         char const *buf, size_t len)
 {
-    static timex_t const time_zero = { 0 };
     static char const * const level_map[] = {
         [RDLOG_ERR] = "ERR",
         [RDLOG_WRN] = "WRN",
@@ -33,41 +223,334 @@ void _rdlog(unsigned level, char const *fmt, ...)
         [RDLOG_DBG] = "DBG"
     };
 
-    if (!fmt) return;
-    if (level == 0 || level > RDLOG_DBG) return;
+    *rec = (record_t){
+        .timestamp = timestamp,
+        .name = level_map[level]
+    };
 
-    char *buf = malloc(RDLOG_LOG_MAXLEN);
-    if (!buf) return;
+#if RDLOG_BINARY == 1
+    rec->type = RECORDTYPE_DATA;
+    rec->data = malloc(RECORD_DATA_SIZE(len));
+    if (!rec->data) return -ENOMEM;
 
+    rec->data->len = len;
+    memcpy(rec->data->bytes, buf, len);
+#else
+    rec->type = RECORDTYPE_STRING;
+    rec->str  = malloc(len + 1);
+    if (!rec->str) return -ENOMEM;
+
+    memcpy(rec->str, buf, len);
+    rec->str[len] = '\0';
+#endif
+
+    return 0;
+}
+
+/* Must be called with the lock held */
+static void _rdlog_put(record_t *rec)
+{
+    int res;
+    if (!_logger || rec->timestamp.seconds == 0) {
+        DDBG("disabled!\n");
+        res = -1;
+    } else {
+        res = recstr_put(_logger, rec);
+    }
+
+    if (res) record_freedata(rec);
+}
+
+#if RDLOG_NOINIT_LEN > 0
+/* Mirror of the last messages in RAM that is not initialized at boot, so it
+ * survives a warm reset. Every entry carries its own check value, so entries
+ * torn by the reset, or garbage after a cold boot, are skipped. */
+#define RDLOG_NOINIT_MAGIC 0x52444c47 /* "RDLG" */
+
+typedef struct {
+    uint32_t seq;
+    uint32_t check;
+    timex_t timestamp;
+    uint8_t level;
+    uint16_t len;
+    char buf[RDLOG_LOG_MAXLEN];
+} rdlog_persist_t;
+
+static struct {
+    uint32_t magic;
+    atomic_uint head;
+    rdlog_persist_t ent[RDLOG_NOINIT_LEN];
+} _persist RDLOG_NOINIT_ATTR;
+
+static uint32_t _rdlog_check(rdlog_persist_t const *ent)
+{
+    /* FNV-1a */
+    uint32_t h = 2166136261u;
+    uint32_t const hdr[] = {
+        ent->seq, ent->timestamp.seconds, ent->timestamp.microseconds,
+        ent->level, ent->len
+    };
+
+    for (size_t i = 0; i < sizeof(hdr); i++) {
+        h = (h ^ ((uint8_t const *)hdr)[i]) * 16777619u;
+    }
+    for (size_t i = 0; i < ent->len; i++) {
+        h = (h ^ (uint8_t)ent->buf[i]) * 16777619u;
+    }
+
+    return h;
+}
+
+static void _rdlog_persist(rdlog_slot_t const *slot)
+{
+    unsigned const seq = atomic_fetch_add(&_persist.head, 1);
+    rdlog_persist_t *ent = &_persist.ent[seq % RDLOG_NOINIT_LEN];
+
+    ent->check     = 0;
+    ent->seq       = seq;
+    ent->timestamp = slot->timestamp;
+    ent->level     = slot->level;
+    ent->len       = slot->len;
+    memcpy(ent->buf, slot->buf, slot->len);
+    ent->check     = _rdlog_check(ent) | 1;
+}
+
+/* Puts the valid entries left by the previous run into the logger, oldest
+ * first, then starts over. Must be called with the lock held, before any new
+ * message is mirrored. */
+static void _rdlog_replay(void)
+{
+    static bool done = false;
+    if (done) return;
+    done = true;
+
+    if (_persist.magic == RDLOG_NOINIT_MAGIC) {
+        unsigned const head = atomic_load(&_persist.head);
+        unsigned replayed = 0;
+
+        for (unsigned i = 0; i < RDLOG_NOINIT_LEN; i++) {
+            unsigned const seq = head - RDLOG_NOINIT_LEN + i;
+            rdlog_persist_t const *ent = &_persist.ent[seq % RDLOG_NOINIT_LEN];
+
+            if (ent->seq != seq || ent->len > RDLOG_LOG_MAXLEN ||
+                ent->level == 0 || ent->level > RDLOG_DBG ||
+                ent->check != (_rdlog_check(ent) | 1)) {
+                continue;
+            }
+
+            record_t rec;
+            if (_rdlog_record(&rec, ent->level, ent->timestamp, ent->buf, ent->len)) {
+                break;
+            }
+
+            _rdlog_put(&rec);
+            replayed++;
+        }
+
+        DINF("%u messages of the previous run replayed\n", replayed);
+    }
+
+    memset(_persist.ent, 0, sizeof(_persist.ent));
+    atomic_store(&_persist.head, 0);
+    _persist.magic = RDLOG_NOINIT_MAGIC;
+}
+#else
+#define _rdlog_persist(slot)
+#define _rdlog_replay()
+#endif
+
+static bool _rdlog_emitv(unsigned level, char const *fmt, va_list args)
+{
+    timex_t (*timef)(void) = _timef;
+    /* Not enabled yet */
+    if (!timef) return true;
+
+    unsigned pos;
+    rdlog_slot_t *slot = slotring_claim(&_ring, &pos);
+    if (!slot) return false;
+
+    slot->level     = level;
+    slot->timestamp = timef();
+
+#if RDLOG_BINARY == 1
+    slot->len = _rdlog_bin((uint8_t *)slot->buf, sizeof(slot->buf), fmt, args);
+#else
+    int const len = vsnprintf(slot->buf, sizeof(slot->buf), fmt, args);
+    slot->len = len < 0 ? 0 : len < (int)sizeof(slot->buf) ? len : sizeof(slot->buf) - 1;
+#endif
+
+    _rdlog_persist(slot);
+    slotring_publish(&_ring, slot, pos);
+
+    if (_drain_pid != KERNEL_PID_UNDEF) {
+        msg_t msg = { .type = RDLOG_MSG_WAKEUP };
+        /* A failure means a wake-up is pending already */
+        msg_try_send(&msg, _drain_pid);
+    }
+
+    return true;
+}
+
+static bool _rdlog_emitf(unsigned level, char const *fmt, ...)
+{
     va_list args;
     va_start(args, fmt);
+    bool const ok = _rdlog_emitv(level, fmt, args);
+    va_end(args);
 
-    vsnprintf(buf, RDLOG_LOG_MAXLEN, fmt, args);
+    return ok;
+}
 
-    va_end(args);
+/* Passes the published slots to the logger */
+static void _rdlog_drain(void)
+{
+    rdlog_slot_t *slot;
 
-    DDBG("%s", buf);
+    while ((slot = slotring_peek(&_ring))) {
+        record_t rec;
+        int res = _rdlog_record(&rec, slot->level, slot->timestamp,
+                                slot->buf, slot->len);
 
-    record_t rec = {
-        .type = RECORDTYPE_STRING,
-        .str = buf,
-        .timestamp = _timef ? _timef() : time_zero,
-        .name = level_map[level]
-    };
+        slotring_release(&_ring, slot);
 
-    mutex_lock(&_lock);
+        if (res) {
+            mempress_raise();
+            continue;
+        }
 
-    int res;
-    if (!_logger || rec.timestamp.seconds == 0) {
-        DDBG("disabled!\n");
-        res = -1;
+        mutex_lock(&_lock);
+        _rdlog_put(&rec);
+        mutex_unlock(&_lock);
+
+        /* Report the losses once there is room again */
+        unsigned const dropped = slotring_dropped(&_ring);
+        if (dropped && !_rdlog_emitf(RDLOG_WRN, "%u messages dropped", dropped)) {
+            atomic_fetch_add(&_ring.dropped, dropped - 1);
+        }
+    }
+}
+
+static void *_rdlog_drain_thread(void *arg)
+{
+    (void)arg;
+
+    static msg_t msg_queue[RDLOG_DRAIN_QUEUE_LEN];
+    msg_init_queue(msg_queue, RDLOG_DRAIN_QUEUE_LEN);
+    msg_t msg;
+
+    while (1) {
+        msg_receive(&msg);
+
+        _rdlog_drain();
+
+        if (msg.type == RDLOG_MSG_SYNC) {
+            /* All the messages before were passed on */
+            if (msg.content.value) {
+                mutex_lock(&_lock);
+                if (_logger) recstr_put(_logger, NULL);
+                mutex_unlock(&_lock);
+            }
+            msg_reply(&msg, &msg);
+        }
+    }
+
+    return NULL;
+}
+
+/* Must be called with the lock held */
+static int _rdlog_drain_init(void)
+{
+    static char drain_stack[RDLOG_DRAIN_STACKSIZE];
+
+    if (_drain_pid != KERNEL_PID_UNDEF) return 0;
+
+    int res = thread_create(
+        drain_stack,
+        sizeof(drain_stack),
+        RDLOG_DRAIN_PRIO,
+        0,
+        _rdlog_drain_thread,
+        NULL,
+        "rdlog");
+
+    if (res < 0) return res;
+
+    _drain_pid = res;
+    return 0;
+}
+
+/* Waits for the drain to pass on the pending messages, and flushes the logger
+ * if asked to */
+static void _rdlog_drain_sync(bool flush)
+{
+    if (_drain_pid == KERNEL_PID_UNDEF) return;
+
+    msg_t msg = { .type = RDLOG_MSG_SYNC, .content.value = flush };
+    msg_send_receive(&msg, &msg, _drain_pid);
+}
+
+static void _rdlog_emit_repeated(unsigned level, char const *fmt, unsigned cnt)
+{
+    _rdlog_emitf(level, "repeated %u times: %s", cnt, fmt);
+}
+
+/* Token bucket of the call site. Returns whether the message may be sent, and
+ * the number of messages suppressed before it. */
+static bool _rdlog_admit(rdlog_site_t *site, unsigned level, char const *fmt,
+                         unsigned *repeated)
+{
+    *repeated = 0;
+
+    if (!site || !RDLOG_RATE_BURST) return true;
+
+    uint32_t const now = ztimer_now(ZTIMER_SEC);
+    unsigned const state = irq_disable();
+
+    uint32_t const refill = (now - site->last) / RDLOG_RATE_PERIOD;
+    if (refill) {
+        site->spent = refill < site->spent ? site->spent - refill : 0;
+        site->last  = site->spent ? site->last + refill * RDLOG_RATE_PERIOD : now;
+    }
+
+    bool const admit = site->spent < RDLOG_RATE_BURST;
+
+    if (admit) {
+        site->spent++;
+        *repeated = site->suppressed;
+        site->suppressed = 0;
     } else {
-        res = recstr_put(_logger, &rec);
+        if (site->suppressed < UINT16_MAX) site->suppressed++;
+        site->fmt   = fmt;
+        site->level = level;
+
+        if (!site->listed) {
+            site->next   = _suppressed;
+            _suppressed  = site;
+            site->listed = true;
+        }
     }
 
-    mutex_unlock(&_lock);
+    irq_restore(state);
+
+    return admit;
+}
+
+void _rdlog(rdlog_site_t *site, unsigned level, char const *fmt, ...)
+{
+    if (!fmt) return;
+    if (level == 0 || level > RDLOG_DBG) return;
+    /* Leave the heap to the data while it is short */
+    if (level > RDLOG_WRN && mempress_high()) return;
+
+    unsigned repeated;
+    if (!_rdlog_admit(site, level, fmt, &repeated)) return;
 
-    if (res) free(rec.str);
+    if (repeated) _rdlog_emit_repeated(level, fmt, repeated);
+
+    va_list args;
+    va_start(args, fmt);
+    _rdlog_emitv(level, fmt, args);
+    va_end(args);
 }
 
 int RDLOG_enable(
@@ -81,6 +564,7 @@ int RDLOG_enable(
         .base_name = base_name,
         .name = "RDLOG",
         .driv = transfer_driv,
+        .flags = RDLOG_LOGGER_FLAGS,
         .record_queue_size = RDLOG_REC_QUEUE_LEN,
         .encoding_buf_size = RDLOG_ENC_BUF_LEN
     };
@@ -95,8 +579,17 @@ int RDLOG_enable(
 
     mutex_lock(&_lock);
 
+    res = _rdlog_drain_init();
+    if (res) {
+        mutex_unlock(&_lock);
+        DERR("cannot start the drain!\n");
+        recstr_close(&logg);
+        return res;
+    }
+
     if (_logger) recstr_close(&_logger);
     _logger = logg;
+    _rdlog_replay();
     _timef = timef;
 
     mutex_unlock(&_lock);
@@ -104,18 +597,80 @@ int RDLOG_enable(
     return 0;
 }
 
-void RDLOG_disable(void)
+int RDLOG_enable_aggr(
+    recstr_t *logger,
+    timex_t (*timef)(void),
+    char const *base_name)
 {
+    if (!logger) return -EINVAL;
+
+    logg_substream_init_t sub_ini = {
+        .name = "RDLOG",
+        .base_name = base_name,
+        .quota = RDLOG_REC_QUEUE_LEN
+    };
+
+    recstr_t *sub;
+    int res = logg_substream_create(logger, &sub_ini, &sub);
+
+    if (res) {
+        DERR("cannot create substream!\n");
+        return res;
+    }
+
     mutex_lock(&_lock);
+
+    res = _rdlog_drain_init();
+    if (res) {
+        mutex_unlock(&_lock);
+        DERR("cannot start the drain!\n");
+        recstr_close(&sub);
+        return res;
+    }
+
     if (_logger) recstr_close(&_logger);
+    _logger = sub;
+    _rdlog_replay();
+    _timef = timef;
+
     mutex_unlock(&_lock);
+
+    return 0;
 }
 
-void RDLOG_flush(void)
+void RDLOG_disable(void)
 {
+    _rdlog_drain_sync(false);
+
     mutex_lock(&_lock);
-    if (_logger) recstr_put(_logger, NULL);
+    if (_logger) recstr_close(&_logger);
     mutex_unlock(&_lock);
 }
 
+void RDLOG_flush(void)
+{
+    /* Report the suppressed messages not followed by a sent one yet */
+    unsigned state = irq_disable();
+    rdlog_site_t *site = _suppressed;
+    _suppressed = NULL;
+
+    while (site) {
+        rdlog_site_t *next = site->next;
+        unsigned const cnt = site->suppressed;
+
+        site->suppressed = 0;
+        site->listed     = false;
+        irq_restore(state);
+
+        if (cnt) _rdlog_emit_repeated(site->level, site->fmt, cnt);
+
+        state = irq_disable();
+        site = next;
+    }
+
+    irq_restore(state);
+
+    _rdlog_drain_sync(true);
+}
+
 #endif /* CONDALF_USE_RDLOG == 1 */
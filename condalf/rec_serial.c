@@ -9,9 +9,11 @@
 #include "rec_serial.h"
 #include "malloc.h"
 #include <errno.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #define DLOG_LEVEL DLOG_INF
+#define DLOG_MODULE "recser"
 #include "dlog.h"
 
 #if DLOG_LEVEL >= DLOG_DBG
@@ -25,6 +27,8 @@
 
 #define ARRAY_MAX_BYTES 4 /**< maximum number of bytes to describe an array */
 
+static ssize_t _recser_flush_simulate(recser_t *rs, size_t cnt);
+
 static void peekcb_init(peekcb_t *pcb, record_t *a, size_t len)
 {
     pcb->ri     = 0;
@@ -130,9 +134,19 @@ int recser_init(recser_t *rs, recser_init_t const *init)
         return -ENOMEM;
     }
 
+    if (init->flags & RECSERF_RLE) {
+        rs->reps = malloc(sizeof(*rs->reps) * init->len_limit);
+        if (!rs->reps) {
+            free(a);
+            record_base_freedata(&rs->base);
+            return -ENOMEM;
+        }
+    }
+
     rs->buf = init->buf;
     rs->fit_cnt = 0;
     peekcb_init(&rs->cb, a, init->len_limit);
+    for (unsigned i = 0; i < RECSER_RLE_NAMES; i++) rs->runs[i] = SIZE_MAX;
     /* Init encoder in simulation mode.
      * Even if n records fit in the buffer, closing the array will require up
      * to ARRAY_MAX_BYTES extra bytes, so we subtract that from the buffer
@@ -144,6 +158,287 @@ int recser_init(recser_t *rs, recser_init_t const *init)
     return 0;
 }
 
+static recser_sub_t *_recser_sub(recser_t *rs, unsigned idx)
+{
+    if (idx == 0 || idx > LOGGER_SUBSTREAMS_MAX) return NULL;
+    return &rs->subs[idx - 1];
+}
+
+static void _recser_sub_free(recser_sub_t *sub)
+{
+    record_base_freedata(&sub->base);
+    memset(sub, 0, sizeof(*sub));
+}
+
+/* Account for a record leaving the queue */
+static void _recser_sub_dequeued(recser_t *rs, record_t const *rec)
+{
+    recser_sub_t *sub = _recser_sub(rs, rec->base);
+    if (!sub) return;
+
+    _assert(sub->cnt > 0);
+    if (--sub->cnt == 0 && sub->removed) _recser_sub_free(sub);
+}
+
+static senml_rep_t *_recser_rep(recser_t *rs, size_t it)
+{
+    return rs->reps ? &rs->reps[it & (rs->cb.len - 1)] : NULL;
+}
+
+/* Encode the queued record with index it */
+static int _recser_enc_put(recser_t *rs, record_t const *rec, size_t it)
+{
+    recser_sub_t *sub = _recser_sub(rs, rec->base);
+    return senml_enc_put_rep(&rs->enc, rec, sub ? sub->base.name : rs->base.name,
+                             _recser_rep(rs, it));
+}
+
+int recser_sub_add(recser_t *rs, record_base_t const *base, size_t quota)
+{
+    if (!rs || !base) return -EINVAL;
+
+    for (unsigned i = 0; i < LOGGER_SUBSTREAMS_MAX; i++) {
+        recser_sub_t *sub = &rs->subs[i];
+        if (sub->used) continue;
+
+        if (record_base_copy(&sub->base, base)) return -ENOMEM;
+        sub->quota = quota;
+        sub->cnt = 0;
+        sub->used = true;
+        sub->removed = false;
+
+        return i + 1;
+    }
+
+    return -ENOSPC;
+}
+
+void recser_sub_remove(recser_t *rs, unsigned idx)
+{
+    if (!rs) return;
+
+    recser_sub_t *sub = _recser_sub(rs, idx);
+    if (!sub || !sub->used) return;
+
+    if (sub->cnt) sub->removed = true;
+    else _recser_sub_free(sub);
+}
+
+size_t recser_pending(recser_t const *rs)
+{
+    if (!rs) return 0;
+    return rs->cb.wi - rs->cb.ri;
+}
+
+int recser_drop(recser_t *rs, bool keep_urgent)
+{
+    if (!rs || !rs->buf.ptr) return -EINVAL;
+
+    record_t rec;
+    if (peekcb_peek(&rs->cb, &rec, NULL)) return -ENODATA;
+    if (keep_urgent && (rec.flags & RECORDF_URGENT)) return -EBUSY;
+
+    _check_inv(rs);
+
+    _assert(peekcb_get(&rs->cb, &rec, 1) == 1);
+    record_freedata(&rec);
+    _recser_sub_dequeued(rs, &rec);
+
+    /* The base names of the remaining records may be encoded differently */
+    senml_enc_init(&rs->enc, NULL, rs->buf.len - ARRAY_MAX_BYTES, &rs->base);
+    ssize_t const fit = _recser_flush_simulate(rs, peekcb_fill(&rs->cb));
+    _assert(fit >= 0);
+    rs->fit_cnt = fit < 0 ? 0 : fit;
+
+    _check_inv(rs);
+
+    return 0;
+}
+
+int recser_resize(recser_t *rs, size_t len_limit, UsefulBuf *buf)
+{
+    if (!rs || !buf || !buf->ptr)   return -EINVAL;
+    if (!rs->buf.ptr)               return -EINVAL;
+    if (len_limit == 0)             return -EINVAL;
+    if (buf->len < ARRAY_MAX_BYTES) return -ENOSPC;
+
+    size_t const fill = peekcb_fill(&rs->cb);
+    if (fill > len_limit) return -EBUSY;
+
+    size_t len = len_limit;
+    while (!(len & 0x1)) len >>= 1;
+    if (len != 1) return -EINVAL;
+
+    _check_inv(rs);
+
+    record_t *a = NULL;
+    senml_rep_t *reps = NULL;
+    if (len_limit != rs->cb.len) {
+        a = malloc(sizeof(*a) * len_limit);
+        if (!a) return -ENOMEM;
+
+        if (rs->reps) {
+            reps = malloc(sizeof(*reps) * len_limit);
+            if (!reps) {
+                free(a);
+                return -ENOMEM;
+            }
+        }
+    }
+
+    UsefulBuf tmp = rs->buf;
+    rs->buf = *buf;
+    *buf = tmp;
+
+    /* Nothing is encoded in the buffer before the swap, so we only have to
+     * simulate again how many of the queued records fit in the new one */
+    senml_enc_init(&rs->enc, NULL, rs->buf.len - ARRAY_MAX_BYTES, &rs->base);
+    ssize_t fit = _recser_flush_simulate(rs, fill);
+
+    if (fill && fit <= 0) {
+        DDBG("buffer too small for the queued records\n");
+        tmp = rs->buf;
+        rs->buf = *buf;
+        *buf = tmp;
+
+        senml_enc_init(&rs->enc, NULL, rs->buf.len - ARRAY_MAX_BYTES, &rs->base);
+        _assert(_recser_flush_simulate(rs, rs->fit_cnt) == (ssize_t)rs->fit_cnt);
+        free(a);
+        free(reps);
+        return -ENOSPC;
+    }
+
+    rs->fit_cnt = fit;
+
+    if (reps) {
+        for (size_t i = 0; i < fill; i++) {
+            reps[i] = *_recser_rep(rs, rs->cb.ri + i);
+        }
+        free(rs->reps);
+        rs->reps = reps;
+    }
+
+    if (a) {
+        /* The queue starts over at position 0 */
+        for (unsigned i = 0; i < RECSER_RLE_NAMES; i++) {
+            size_t const pos = rs->runs[i] - rs->cb.ri;
+            rs->runs[i] = pos < fill ? pos : SIZE_MAX;
+        }
+
+        _assert(peekcb_get(&rs->cb, a, fill) == fill);
+        free(rs->cb.a);
+        peekcb_init(&rs->cb, a, len_limit);
+        rs->cb.wi = fill;
+    }
+
+    _check_inv(rs);
+
+    return 0;
+}
+
+static bool _recser_rle_type(record_t const *rec)
+{
+    return rec->type == RECORDTYPE_U32 || rec->type == RECORDTYPE_I32;
+}
+
+/* The open run of the name and base of rec, NULL if there is none */
+static size_t *_recser_run(recser_t *rs, record_t const *rec)
+{
+    size_t const fill = peekcb_fill(&rs->cb);
+
+    for (unsigned i = 0; i < RECSER_RLE_NAMES; i++) {
+        size_t const it = rs->runs[i];
+        if (it - rs->cb.ri >= fill) continue;
+
+        record_t const *q = &rs->cb.a[it & (rs->cb.len - 1)];
+        if (q->base != rec->base) continue;
+        if (q->name == rec->name || !strcmp(q->name, rec->name)) return &rs->runs[i];
+    }
+
+    return NULL;
+}
+
+/* Make the record queued at it the open run of its name */
+static void _recser_run_open(recser_t *rs, size_t it)
+{
+    record_t const *rec = &rs->cb.a[it & (rs->cb.len - 1)];
+    size_t *run = _recser_run(rs, rec);
+
+    if (!run) {
+        /* Runs of other types than the numeric ones never grow */
+        if (!_recser_rle_type(rec)) return;
+
+        /* An unused entry, otherwise the one queued the longest ago */
+        size_t const fill = peekcb_fill(&rs->cb);
+        size_t oldest = SIZE_MAX;
+
+        for (unsigned i = 0; i < RECSER_RLE_NAMES; i++) {
+            size_t const pos = rs->runs[i] - rs->cb.ri;
+            if (pos >= fill) {
+                run = &rs->runs[i];
+                break;
+            }
+            if (pos < oldest) {
+                oldest = pos;
+                run = &rs->runs[i];
+            }
+        }
+    }
+
+    *run = it;
+}
+
+/* Extend the open run of the name of rec. Returns 0 or -EAGAIN like
+ * recser_put() on success, -ENOENT if rec doesn't continue the run. */
+static int _recser_rle(recser_t *rs, record_t const *rec)
+{
+    if (!rs->reps || !_recser_rle_type(rec)) return -ENOENT;
+
+    size_t const *run = _recser_run(rs, rec);
+    if (!run) return -ENOENT;
+
+    size_t const it = *run;
+    record_t const *last = &rs->cb.a[it & (rs->cb.len - 1)];
+    senml_rep_t *rep = _recser_rep(rs, it);
+
+    if (last->type != rec->type || last->u32 != rec->u32 ||
+        last->unit != rec->unit || last->flags != rec->flags) {
+        return -ENOENT;
+    }
+
+    uint64_t const t = timex_uint64(rec->timestamp);
+    uint64_t const t_last = timex_uint64(rep->last);
+    if (t <= t_last) return -ENOENT;
+
+    if (rep->cnt > 1) {
+        /* The backend spreads the run evenly, keep the spacing */
+        uint64_t const step = (t_last - timex_uint64(last->timestamp)) /
+                              (rep->cnt - 1);
+        uint64_t const d = t - t_last;
+        if ((d > step ? d - step : step - d) > RECSER_RLE_JITTER_US) return -ENOENT;
+    }
+
+    bool const fitted = it - rs->cb.ri < rs->fit_cnt;
+    size_t const rep_len = senml_enc_rep_len(rep);
+
+    rep->cnt++;
+    rep->last = rec->timestamp;
+
+    /* The record grew by its run fields. Only if that overflows the buffer,
+     * simulate again how many fit. */
+    if (fitted &&
+        senml_enc_grow(&rs->enc, senml_enc_rep_len(rep) - rep_len)) {
+        senml_enc_init(&rs->enc, NULL, rs->buf.len - ARRAY_MAX_BYTES, &rs->base);
+        ssize_t const fit = _recser_flush_simulate(rs, peekcb_fill(&rs->cb));
+        _assert(fit > 0);
+        rs->fit_cnt = fit < 0 ? 0 : fit;
+    }
+
+    _check_inv(rs);
+
+    return rs->fit_cnt < peekcb_fill(&rs->cb) ? -EAGAIN : 0;
+}
+
 int recser_put(recser_t *rs, record_t *rec)
 {
     if (!rs || !rec) return -EINVAL;
@@ -154,15 +449,29 @@ int recser_put(recser_t *rs, record_t *rec)
 
     _check_inv(rs);
 
+    recser_sub_t *const sub = _recser_sub(rs, rec->base);
+    if (rec->base && (!sub || !sub->used || sub->removed)) return -EINVAL;
+
+    int ret = _recser_rle(rs, rec);
+    if (ret != -ENOENT) return ret;
+
     record_t nrec;
     record_move(&nrec, rec);
 
-    if (peekcb_fill(&rs->cb) == rs->cb.len) {
+    if (peekcb_fill(&rs->cb) == rs->cb.len ||
+        (sub && sub->quota && sub->cnt >= sub->quota)) {
         record_move(rec, &nrec);
         return -ENOSPC;
     }
 
-    int ret = senml_enc_put(&rs->enc, &nrec);
+    size_t const it = rs->cb.wi;
+    senml_rep_t *const rep = _recser_rep(rs, it);
+    if (rep) {
+        rep->cnt = 1;
+        rep->last = nrec.timestamp;
+    }
+
+    ret = _recser_enc_put(rs, &nrec, it);
     if (ret == -ENOSPC) {
         if (rs->fit_cnt == 0) {
             /* Buffer cannot fit even one record */
@@ -171,6 +480,8 @@ int recser_put(recser_t *rs, record_t *rec)
         }
 
         _assert(peekcb_put(&rs->cb, &nrec, 1) == 1);
+        if (sub) sub->cnt++;
+        if (rep) _recser_run_open(rs, it);
         return -EAGAIN;
     }
 
@@ -181,6 +492,8 @@ int recser_put(recser_t *rs, record_t *rec)
     }
 
     _assert(peekcb_put(&rs->cb, &nrec, 1) == 1);
+    if (sub) sub->cnt++;
+    if (rep) _recser_run_open(rs, it);
     rs->fit_cnt++;
 
     _check_inv(rs);
@@ -200,7 +513,7 @@ static ssize_t _recser_flush_simulate(recser_t *rs, size_t cnt)
     if (res == -ENODATA) return flushed;
 
     do {
-        res = senml_enc_put(&rs->enc, &rec);
+        res = _recser_enc_put(rs, &rec, it);
         if (res == -ENOSPC) break;
         if (res) return res;
 
@@ -220,15 +533,24 @@ static ssize_t _recser_flush(recser_t *rs, size_t cnt)
     int flushed = 0;
 
     while (cnt--) {
+        size_t const it = rs->cb.ri;
         int res = peekcb_get(&rs->cb, &rec, 1);
 
         _assert(res == 1);
 
-        res = senml_enc_put(&rs->enc, &rec);
-        if (rec.type == RECORDTYPE_STRING) free(rec.str);
+        res = _recser_enc_put(rs, &rec, it);
+        record_freedata(&rec);
+        _recser_sub_dequeued(rs, &rec);
         if (res == -ENOSPC) break;
         if (res) return res;
 
+        senml_rep_t const *rep = _recser_rep(rs, it);
+        uint32_t const t_last = rep && rep->cnt > 1 ? rep->last.seconds :
+                                                      rec.timestamp.seconds;
+
+        if (rec.timestamp.seconds < rs->t_min) rs->t_min = rec.timestamp.seconds;
+        if (t_last > rs->t_max) rs->t_max = t_last;
+
         flushed++;
     }
 
@@ -249,6 +571,9 @@ int recser_swap(recser_t *rs, UsefulBuf *out)
 
     size_t enc_len;
 
+    rs->t_min = UINT32_MAX;
+    rs->t_max = 0;
+
     if (rs->fit_cnt > 0) {
         senml_enc_init(&rs->enc, rs->buf.ptr, rs->buf.len, &rs->base);
         int const fit_cnt = rs->fit_cnt;
@@ -279,7 +604,11 @@ int recser_swap(recser_t *rs, UsefulBuf *out)
         _check_inv(rs);
 
         free(rs->cb.a);
+        free(rs->reps);
         record_base_freedata(&rs->base);
+        for (unsigned i = 0; i < LOGGER_SUBSTREAMS_MAX; i++) {
+            if (rs->subs[i].used) _recser_sub_free(&rs->subs[i]);
+        }
 
         return 0;
     }
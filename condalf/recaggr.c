@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+#include "recaggr.h"
+#include "recwin.h"
+#include "condalf_config.h"
+#include "malloc.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DLOG_LEVEL DLOG_INF
+#define DLOG_MODULE "recaggr"
+#include "dlog.h"
+
+enum {
+    AGGR_MIN,
+    AGGR_MAX,
+    AGGR_MEAN,
+    AGGR_COUNT,
+
+    AGGR_NUMOF
+};
+
+static char const * const _suffix[AGGR_NUMOF] = {
+    [AGGR_MIN]   = ":min",
+    [AGGR_MAX]   = ":max",
+    [AGGR_MEAN]  = ":mean",
+    [AGGR_COUNT] = ":count"
+};
+
+/* Open window, per name */
+typedef struct recaggr_win {
+    recwin_win_t hdr;
+    char *names[AGGR_NUMOF];    /**< summary names, in a single allocation */
+    int64_t min;
+    int64_t max;
+    int64_t sum;
+} recaggr_win_t;
+
+static recstr_itf_t const recstr_impl;
+static recwin_ops_t const recwin_impl;
+
+int recaggr_create(recaggr_init_t const *init, recstr_t **aggr)
+{
+    if (!init || !aggr) return -EINVAL;
+
+    recwin_t *a = calloc(1, sizeof(*a));
+    if (!a) return -ENOMEM;
+
+    recwin_init_t const winit = {
+        .itf       = &recstr_impl,
+        .ops       = &recwin_impl,
+        .win_size  = sizeof(recaggr_win_t),
+        .next      = init->next,
+        .name      = init->name,
+        .window    = init->window,
+        .names_max = init->names_max ? init->names_max : RECAGGR_NAMES_MAX
+    };
+
+    int res = recwin_init(a, &winit);
+    if (res) {
+        free(a);
+        return res;
+    }
+
+    *aggr = (recstr_t *)a;
+    return 0;
+}
+
+static int _recaggr_open(recwin_t *rw, recwin_win_t *hdr, char const *name)
+{
+    (void)rw;
+    recaggr_win_t *win = (recaggr_win_t *)hdr;
+
+    size_t len = 0;
+    for (unsigned i = 0; i < AGGR_NUMOF; i++) {
+        len += strlen(name) + strlen(_suffix[i]) + 1;
+    }
+
+    char *buf = malloc(len);
+    if (!buf) return -ENOMEM;
+
+    for (unsigned i = 0; i < AGGR_NUMOF; i++) {
+        win->names[i] = buf;
+        buf += sprintf(buf, "%s%s", name, _suffix[i]) + 1;
+    }
+
+    return 0;
+}
+
+static void _recaggr_add(recwin_t *rw, recwin_win_t *hdr, int64_t val)
+{
+    (void)rw;
+    recaggr_win_t *win = (recaggr_win_t *)hdr;
+
+    if (!hdr->cnt) {
+        win->min = val;
+        win->max = val;
+        win->sum = 0;
+    }
+
+    if (val < win->min) win->min = val;
+    if (val > win->max) win->max = val;
+    win->sum += val;
+}
+
+/* Pass the summary of a window on */
+static int _recaggr_emit(recwin_t *rw, recwin_win_t *hdr)
+{
+    recaggr_win_t *win = (recaggr_win_t *)hdr;
+
+    int64_t const vals[AGGR_NUMOF] = {
+        [AGGR_MIN]   = win->min,
+        [AGGR_MAX]   = win->max,
+        [AGGR_MEAN]  = win->sum / hdr->cnt,
+        [AGGR_COUNT] = hdr->cnt
+    };
+
+    int res = 0;
+
+    for (unsigned i = 0; i < AGGR_NUMOF; i++) {
+        record_t rec = {
+            .name = win->names[i],
+            .timestamp.seconds = hdr->start,
+            .type = i == AGGR_COUNT ? RECORDTYPE_U32 : hdr->type,
+            .unit = i == AGGR_COUNT ? RECORDUNIT_count : hdr->unit
+        };
+
+        if (rec.type == RECORDTYPE_U32) rec.u32 = vals[i];
+        else rec.i32 = vals[i];
+
+        int res2 = recstr_put(rw->next, &rec);
+        if (res2) {
+            DERR("%s: %s lost: %d\n", rw->stream.name, rec.name, res2);
+            if (!res) res = res2;
+        }
+    }
+
+    return res;
+}
+
+static void _recaggr_release(recwin_win_t *hdr)
+{
+    free(((recaggr_win_t *)hdr)->names[0]);
+}
+
+static int _recaggr_put(recstr_t *rstr, record_t *rec)
+{
+    return recwin_put((recwin_t *)rstr, rec);
+}
+
+static int _recaggr_close(recstr_t **rstr)
+{
+    int res = recwin_close((recwin_t *)*rstr);
+
+    free(*rstr);
+    *rstr = NULL;
+
+    return res;
+}
+
+static recwin_ops_t const recwin_impl = {
+    .open    = _recaggr_open,
+    .add     = _recaggr_add,
+    .emit    = _recaggr_emit,
+    .release = _recaggr_release
+};
+
+static recstr_itf_t const recstr_impl = {
+    .put    = _recaggr_put,
+    .close  = _recaggr_close
+};
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+#include "recfilt.h"
+#include "recnmap.h"
+#include "condalf_config.h"
+#include "malloc.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define DLOG_LEVEL DLOG_INF
+#define DLOG_MODULE "recfilt"
+#include "dlog.h"
+
+/* Last record passed on, per name */
+typedef struct recfilt_last {
+    int64_t val;
+    uint32_t seconds;
+    bool valid;
+} recfilt_last_t;
+
+typedef struct recfilt {
+    recstr_t stream;
+    recstr_t *next;
+    uint32_t abs_deadband;
+    unsigned rel_deadband;
+    uint32_t heartbeat;
+    recnmap_t names;
+    recfilt_last_t *last;
+} recfilt_t;
+
+static recstr_itf_t const recstr_impl;
+
+int recfilt_create(recfilt_init_t const *init, recstr_t **filt)
+{
+    if (!init || !filt || !init->next) return -EINVAL;
+
+    recfilt_t *f = calloc(1, sizeof(*f));
+    if (!f) return -ENOMEM;
+
+    size_t const names_max = init->names_max ? init->names_max : RECFILT_NAMES_MAX;
+
+    int res = recnmap_init(&f->names, names_max);
+    if (res) {
+        free(f);
+        return res;
+    }
+
+    f->last = calloc(names_max, sizeof(*f->last));
+    if (!f->last) {
+        recnmap_free(&f->names);
+        free(f);
+        return -ENOMEM;
+    }
+
+    f->stream.itf    = &recstr_impl;
+    f->next          = init->next;
+    f->abs_deadband  = init->abs_deadband;
+    f->rel_deadband  = init->rel_deadband;
+    f->heartbeat     = init->heartbeat;
+
+    mutex_init(&f->stream.lock);
+
+    strncpy(
+        f->stream.name,
+        init->name ? init->name : "<none>",
+        RECORDSTREAM_MAX_STR_LEN);
+
+    f->stream.name[RECORDSTREAM_MAX_STR_LEN] = '\0';
+
+    *filt = (recstr_t *)f;
+    return 0;
+}
+
+static bool _recfilt_val(record_t const *rec, int64_t *val)
+{
+    switch (rec->type) {
+    case RECORDTYPE_U32:
+        *val = rec->u32;
+        return true;
+    case RECORDTYPE_I32:
+        *val = rec->i32;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool _recfilt_pass(recfilt_t *f, recfilt_last_t const *last,
+                          record_t const *rec, int64_t val)
+{
+    if (!last->valid) return true;
+
+    if (f->heartbeat &&
+        rec->timestamp.seconds - last->seconds >= f->heartbeat) {
+        return true;
+    }
+
+    int64_t const delta = val > last->val ? val - last->val : last->val - val;
+    int64_t const ref = last->val < 0 ? -last->val : last->val;
+
+    if (!f->abs_deadband && !f->rel_deadband) return delta != 0;
+    if (f->abs_deadband && delta > f->abs_deadband) return true;
+    if (f->rel_deadband && delta * 100 > ref * f->rel_deadband) return true;
+
+    return false;
+}
+
+static int _recfilt_put(recstr_t *rstr, record_t *rec)
+{
+    recfilt_t *f = (recfilt_t *)rstr;
+
+    if (!rec) return recstr_put(f->next, NULL);
+
+    int64_t val;
+    if (!rec->name || !_recfilt_val(rec, &val) || (rec->flags & RECORDF_URGENT)) {
+        return recstr_put(f->next, rec);
+    }
+
+    int idx = recnmap_find(&f->names, rec->name, true);
+    if (idx < 0) {
+        DDBG("%s: untracked name %s\n", rstr->name, rec->name);
+        return recstr_put(f->next, rec);
+    }
+
+    recfilt_last_t *last = &f->last[idx];
+
+    if (!_recfilt_pass(f, last, rec, val)) {
+        DDBG("%s: %s filtered\n", rstr->name, rec->name);
+        return 0;
+    }
+
+    int res = recstr_put(f->next, rec);
+
+    if (res == 0) {
+        last->val     = val;
+        last->seconds = rec->timestamp.seconds;
+        last->valid   = true;
+    }
+
+    return res;
+}
+
+static int _recfilt_close(recstr_t **rstr)
+{
+    recfilt_t *f = (recfilt_t *)*rstr;
+
+    recnmap_free(&f->names);
+    free(f->last);
+    free(f);
+    *rstr = NULL;
+
+    return 0;
+}
+
+static recstr_itf_t const recstr_impl = {
+    .put    = _recfilt_put,
+    .close  = _recfilt_close
+};
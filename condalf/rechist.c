@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+#include "rechist.h"
+#include "recwin.h"
+#include "condalf_config.h"
+#include "malloc.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DLOG_LEVEL DLOG_INF
+#define DLOG_MODULE "rechist"
+#include "dlog.h"
+
+#define HIST_SUFFIX ":hist"
+
+/* Open window, per name */
+typedef struct rechist_win {
+    recwin_win_t hdr;
+    char *name;
+    record_hist_t *hist;
+} rechist_win_t;
+
+typedef struct rechist {
+    recwin_t rw;
+    int32_t lo;
+    uint32_t width;
+    uint8_t nb;
+    uint8_t flags;
+} rechist_t;
+
+static recstr_itf_t const recstr_impl;
+static recwin_ops_t const recwin_impl;
+
+int rechist_create(rechist_init_t const *init, recstr_t **hist)
+{
+    if (!init || !hist || !init->width) return -EINVAL;
+    if (!init->nb_buckets || init->nb_buckets > RECHIST_BUCKETS_MAX) return -EINVAL;
+
+    rechist_t *h = calloc(1, sizeof(*h));
+    if (!h) return -ENOMEM;
+
+    recwin_init_t const winit = {
+        .itf       = &recstr_impl,
+        .ops       = &recwin_impl,
+        .win_size  = sizeof(rechist_win_t),
+        .next      = init->next,
+        .name      = init->name,
+        .window    = init->window,
+        .names_max = init->names_max ? init->names_max : RECHIST_NAMES_MAX
+    };
+
+    int res = recwin_init(&h->rw, &winit);
+    if (res) {
+        free(h);
+        return res;
+    }
+
+    h->lo    = init->lo;
+    h->width = init->width;
+    h->nb    = init->nb_buckets;
+    h->flags = init->flags;
+
+    *hist = (recstr_t *)h;
+    return 0;
+}
+
+static int _rechist_open(recwin_t *rw, recwin_win_t *hdr, char const *name)
+{
+    rechist_t *h = (rechist_t *)rw;
+    rechist_win_t *win = (rechist_win_t *)hdr;
+
+    win->name = malloc(strlen(name) + sizeof(HIST_SUFFIX));
+    win->hist = calloc(1, RECORD_HIST_SIZE(h->nb));
+
+    if (!win->name || !win->hist) {
+        free(win->name);
+        free(win->hist);
+        win->name = NULL;
+        win->hist = NULL;
+        return -ENOMEM;
+    }
+
+    sprintf(win->name, "%s"HIST_SUFFIX, name);
+
+    win->hist->lo    = h->lo;
+    win->hist->width = h->width;
+    win->hist->flags = h->flags;
+    win->hist->nb    = h->nb;
+
+    return 0;
+}
+
+static unsigned _rechist_bucket(record_hist_t const *hist, int64_t val)
+{
+    if (val < hist->lo) return 0;
+
+    uint64_t const steps = (uint64_t)(val - hist->lo) / hist->width;
+    uint64_t idx = steps;
+
+    if (hist->flags & RECORD_HISTF_LOG) {
+        /* bucket i > 0 holds the steps in [2^(i-1), 2^i) */
+        idx = steps ? 64 - __builtin_clzll(steps) : 0;
+    }
+
+    return idx < hist->nb ? idx : hist->nb - 1;
+}
+
+static void _rechist_add(recwin_t *rw, recwin_win_t *hdr, int64_t val)
+{
+    (void)rw;
+    record_hist_t *hist = ((rechist_win_t *)hdr)->hist;
+
+    hist->buckets[_rechist_bucket(hist, val)]++;
+    hist->sum += val;
+    hist->cnt++;
+}
+
+/* Pass the histogram of a window on */
+static int _rechist_emit(recwin_t *rw, recwin_win_t *hdr)
+{
+    rechist_t *h = (rechist_t *)rw;
+    rechist_win_t *win = (rechist_win_t *)hdr;
+
+    record_t rec = {
+        .name = win->name,
+        .timestamp.seconds = hdr->start,
+        .type = RECORDTYPE_HIST,
+        .unit = hdr->unit,
+        .hist = win->hist
+    };
+
+    record_t nrec;
+    int res = record_copy(&nrec, &rec);
+    if (res == 0) {
+        res = recstr_put(rw->next, &nrec);
+        if (res) record_freedata(&nrec);
+    }
+
+    if (res) DERR("%s: %s lost: %d\n", rw->stream.name, win->name, res);
+
+    win->hist->cnt = 0;
+    win->hist->sum = 0;
+    memset(win->hist->buckets, 0, h->nb * sizeof(win->hist->buckets[0]));
+
+    return res;
+}
+
+static void _rechist_release(recwin_win_t *hdr)
+{
+    rechist_win_t *win = (rechist_win_t *)hdr;
+
+    free(win->name);
+    free(win->hist);
+}
+
+static int _rechist_put(recstr_t *rstr, record_t *rec)
+{
+    return recwin_put((recwin_t *)rstr, rec);
+}
+
+static int _rechist_close(recstr_t **rstr)
+{
+    int res = recwin_close((recwin_t *)*rstr);
+
+    free(*rstr);
+    *rstr = NULL;
+
+    return res;
+}
+
+static recwin_ops_t const recwin_impl = {
+    .open    = _rechist_open,
+    .add     = _rechist_add,
+    .emit    = _rechist_emit,
+    .release = _rechist_release
+};
+
+static recstr_itf_t const recstr_impl = {
+    .put    = _rechist_put,
+    .close  = _rechist_close
+};
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+#include "recnmap.h"
+#include "malloc.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/* 32 bit FNV-1a */
+static uint32_t _fnv1a(char const *s)
+{
+    uint32_t h = 2166136261u;
+
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+int recnmap_init(recnmap_t *map, size_t len)
+{
+    if (!map || len == 0 || (len & (len - 1))) return -EINVAL;
+
+    map->names = calloc(len, sizeof(*map->names));
+    if (!map->names) return -ENOMEM;
+
+    map->len = len;
+
+    return 0;
+}
+
+void recnmap_free(recnmap_t *map)
+{
+    if (!map) return;
+
+    for (size_t i = 0; map->names && i < map->len; i++) {
+        free(map->names[i]);
+    }
+
+    free(map->names);
+    map->names = NULL;
+    map->len = 0;
+}
+
+int recnmap_find(recnmap_t *map, char const *name, bool add)
+{
+    if (!map || !map->names || !name) return -EINVAL;
+
+    size_t const msk = map->len - 1;
+    size_t idx = _fnv1a(name) & msk;
+
+    /* Linear probing, the names are never removed */
+    for (size_t i = 0; i < map->len; i++, idx = (idx + 1) & msk) {
+        char const *slot = map->names[idx];
+
+        if (!slot) {
+            if (!add) return -ENOENT;
+
+            /* The caller may free or reuse the name after a flush */
+            map->names[idx] = strdup(name);
+            return map->names[idx] ? (int)idx : -ENOMEM;
+        }
+
+        if (!strcmp(slot, name)) return idx;
+    }
+
+    return add ? -ENOSPC : -ENOENT;
+}
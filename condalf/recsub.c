@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+#include "recsub.h"
+#include <errno.h>
+#include <string.h>
+
+#define DLOG_LEVEL DLOG_INF
+#define DLOG_MODULE "recsub"
+#include "dlog.h"
+
+static void _recsub_ring_cb(recstr_sub_t *sub, record_t const *rec)
+{
+    recsub_ring_t *ring = (recsub_ring_t *)sub;
+
+    mutex_lock(&ring->lock);
+
+    if (ring->wi - ring->ri == ring->len ||
+        record_copy(&ring->a[ring->wi & (ring->len - 1)], rec)) {
+        ring->dropped++;
+    } else {
+        ring->wi++;
+    }
+
+    mutex_unlock(&ring->lock);
+}
+
+int recsub_ring_init(recsub_ring_t *ring, record_t *buf, size_t len,
+                     char const *name)
+{
+    if (!ring || !buf || len == 0 || (len & (len - 1))) return -EINVAL;
+
+    memset(ring, 0, sizeof(*ring));
+
+    ring->sub.cb   = _recsub_ring_cb;
+    ring->sub.name = name;
+    ring->a        = buf;
+    ring->len      = len;
+
+    mutex_init(&ring->lock);
+
+    return 0;
+}
+
+int recsub_ring_get(recsub_ring_t *ring, record_t *rec)
+{
+    if (!ring || !rec) return -EINVAL;
+
+    int ret = -ENODATA;
+
+    mutex_lock(&ring->lock);
+
+    if (ring->wi != ring->ri) {
+        *rec = ring->a[ring->ri++ & (ring->len - 1)];
+        ret = 0;
+    }
+
+    mutex_unlock(&ring->lock);
+
+    return ret;
+}
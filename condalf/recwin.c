@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+#include "recwin.h"
+#include "malloc.h"
+#include <errno.h>
+#include <string.h>
+
+#define DLOG_LEVEL DLOG_INF
+#define DLOG_MODULE "recwin"
+#include "dlog.h"
+
+static recwin_win_t *_recwin_win(recwin_t *rw, size_t idx)
+{
+    return (recwin_win_t *)(rw->wins + idx * rw->win_size);
+}
+
+int recwin_init(recwin_t *rw, recwin_init_t const *init)
+{
+    if (!rw || !init || !init->itf || !init->ops || !init->next) return -EINVAL;
+    if (!init->window || init->win_size < sizeof(recwin_win_t)) return -EINVAL;
+
+    int res = recnmap_init(&rw->names, init->names_max);
+    if (res) return res;
+
+    rw->wins = calloc(init->names_max, init->win_size);
+    if (!rw->wins) {
+        recnmap_free(&rw->names);
+        return -ENOMEM;
+    }
+
+    rw->stream.itf = init->itf;
+    rw->next       = init->next;
+    rw->ops        = init->ops;
+    rw->window     = init->window;
+    rw->win_size   = init->win_size;
+    rw->oldest     = UINT32_MAX;
+
+    mutex_init(&rw->stream.lock);
+
+    strncpy(
+        rw->stream.name,
+        init->name ? init->name : "<none>",
+        RECORDSTREAM_MAX_STR_LEN);
+
+    rw->stream.name[RECORDSTREAM_MAX_STR_LEN] = '\0';
+
+    return 0;
+}
+
+static int _recwin_emit(recwin_t *rw, recwin_win_t *win)
+{
+    if (!win->cnt) return 0;
+
+    int res = rw->ops->emit(rw, win);
+    win->cnt = 0;
+
+    return res;
+}
+
+/* Pass on the windows that ended before \p start */
+static int _recwin_expire(recwin_t *rw, uint32_t start)
+{
+    if (rw->oldest >= start) return 0;
+
+    int res = 0;
+    uint32_t oldest = UINT32_MAX;
+
+    for (size_t i = 0; i < rw->names.len; i++) {
+        recwin_win_t *win = _recwin_win(rw, i);
+        if (!win->cnt) continue;
+
+        if (win->start < start) {
+            int res2 = _recwin_emit(rw, win);
+            if (!res) res = res2;
+        }
+        else if (win->start < oldest) {
+            oldest = win->start;
+        }
+    }
+
+    rw->oldest = oldest;
+
+    return res;
+}
+
+/* Pass a record on as it is, keeping the error of an expired window */
+static int _recwin_pass(recwin_t *rw, record_t *rec, int res)
+{
+    int res2 = recstr_put(rw->next, rec);
+    return res2 ? res2 : res;
+}
+
+int recwin_put(recwin_t *rw, record_t *rec)
+{
+    if (!rec) {
+        int res = _recwin_expire(rw, rw->latest);
+        int res2 = recstr_put(rw->next, NULL);
+        return res ? res : res2;
+    }
+
+    uint32_t const start = rec->timestamp.seconds -
+                           rec->timestamp.seconds % rw->window;
+
+    /* A quiet name must not hold its window until its next sample */
+    int res = _recwin_expire(rw, start);
+    if (start > rw->latest) rw->latest = start;
+
+    int64_t val;
+    switch (rec->type) {
+    case RECORDTYPE_U32: val = rec->u32; break;
+    case RECORDTYPE_I32: val = rec->i32; break;
+    default:             return _recwin_pass(rw, rec, res);
+    }
+
+    if (!rec->name) return _recwin_pass(rw, rec, res);
+
+    int idx = recnmap_find(&rw->names, rec->name, true);
+    if (idx < 0) {
+        DDBG("%s: untracked name %s\n", rw->stream.name, rec->name);
+        return _recwin_pass(rw, rec, res);
+    }
+
+    recwin_win_t *win = _recwin_win(rw, idx);
+
+    if (!win->ready) {
+        if (rw->ops->open(rw, win, rec->name)) return -ENOMEM;
+        win->ready = true;
+    }
+
+    if (win->cnt && start < win->start) {
+        /* A late sample, its window was passed on already */
+        return _recwin_pass(rw, rec, res);
+    }
+
+    if (rec->flags & RECORDF_URGENT) {
+        int res2 = recstr_put(rw->next, rec);
+        if (res2) return res2;
+    }
+
+    if (!win->cnt) {
+        win->start = start;
+        win->unit  = rec->unit;
+        win->type  = rec->type;
+        if (start < rw->oldest) rw->oldest = start;
+    }
+
+    rw->ops->add(rw, win, val);
+    win->cnt++;
+
+    return res;
+}
+
+int recwin_close(recwin_t *rw)
+{
+    int res = 0;
+
+    mutex_lock(&rw->stream.lock);
+
+    for (size_t i = 0; i < rw->names.len; i++) {
+        int res2 = _recwin_emit(rw, _recwin_win(rw, i));
+        if (!res) res = res2;
+    }
+
+    /* The summary names must not be referenced anymore */
+    int res2 = recstr_put(rw->next, NULL);
+    if (!res) res = res2;
+
+    mutex_unlock(&rw->stream.lock);
+
+    for (size_t i = 0; i < rw->names.len; i++) {
+        recwin_win_t *win = _recwin_win(rw, i);
+        if (win->ready) rw->ops->release(win);
+    }
+
+    recnmap_free(&rw->names);
+    free(rw->wins);
+
+    return res;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+#include "remconf.h"
+#include "condalf_config.h"
+#include "vstorage.h"
+#include "qcbor.h"
+#include "malloc.h"
+#include "vfs.h"
+#include <errno.h>
+#include <string.h>
+
+#define DLOG_LEVEL DLOG_INF
+#define DLOG_MODULE "remconf"
+#include "dlog.h"
+
+int remconf_decode(void const *buf, size_t len, remconf_t *conf)
+{
+    if (!buf || !conf) return -EINVAL;
+
+    QCBORDecodeContext ctx;
+    QCBORItem item;
+    UsefulBufC const ub = { .ptr = buf, .len = len };
+
+    QCBORDecode_Init(&ctx, ub, QCBOR_DECODE_MODE_NORMAL);
+
+    if (QCBORDecode_GetNext(&ctx, &item) != QCBOR_SUCCESS ||
+        item.uDataType != QCBOR_TYPE_MAP) {
+        DERR("not a map\n");
+        return -EBADMSG;
+    }
+
+    /* Indefinite length maps are reported with UINT16_MAX entries */
+    if (item.val.uCount == UINT16_MAX) return -EBADMSG;
+
+    memset(conf, 0, sizeof(*conf));
+
+    for (unsigned i = item.val.uCount; i; i--) {
+        if (QCBORDecode_GetNext(&ctx, &item) != QCBOR_SUCCESS) return -EBADMSG;
+
+        /* Skipping nested items is not worth the code */
+        if (item.uDataType == QCBOR_TYPE_MAP ||
+            item.uDataType == QCBOR_TYPE_ARRAY) return -EBADMSG;
+
+        if (item.uLabelType != QCBOR_TYPE_INT64 ||
+            item.label.int64 <= 0 || item.label.int64 >= REMCONF_KEY_NUMOF) {
+            DDBG("unknown key ignored\n");
+            continue;
+        }
+
+        unsigned const key = item.label.int64;
+
+        if (item.uDataType != QCBOR_TYPE_INT64 ||
+            item.val.int64 < 0 || item.val.int64 > UINT32_MAX) {
+            DWRN("key %u: invalid value\n", key);
+            continue;
+        }
+
+        conf->val[key] = item.val.int64;
+        conf->mask |= 1UL << key;
+    }
+
+    if (QCBORDecode_Finish(&ctx) != QCBOR_SUCCESS) return -EBADMSG;
+
+    return 0;
+}
+
+int remconf_fetch(transdrv_t *drv, remconf_t *conf)
+{
+    if (!drv || !conf) return -EINVAL;
+
+    char *buf = malloc(REMCONF_MAXLEN);
+    if (!buf) return -ENOMEM;
+
+    vstorfile_init_t vf_init = {
+        .buf    = buf,
+        .bufsiz = REMCONF_MAXLEN,
+        .flags  = VSTORF_OWNS_BUF
+    };
+
+    int fd = vstorfile_open(&vf_init);
+    if (fd < 0) {
+        free(buf);
+        return fd;
+    }
+
+    transfer_job_t job = {
+        .fd = fd
+    };
+
+    int res = transdrv_recv(drv, &job);
+    if (res) {
+        DERR("cannot fetch: %d\n", res);
+        goto _remconf_fetch_end;
+    }
+
+    /* The receive transfer leaves the position at the end of the data */
+    off_t const len = vfs_lseek(fd, 0, SEEK_CUR);
+    if (len < 0) {
+        res = len;
+        goto _remconf_fetch_end;
+    }
+
+    res = remconf_decode(buf, len, conf);
+    if (res) {
+        DERR("cannot decode: %d\n", res);
+    } else {
+        DINF("fetched, mask=0x%x\n", (unsigned)conf->mask);
+    }
+
+_remconf_fetch_end:
+    vfs_close(fd);
+    return res;
+}
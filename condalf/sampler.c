@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+#include "sampler.h"
+#include "condalf_config.h"
+#include "malloc.h"
+#include "msg.h"
+#include "thread.h"
+#include "ztimer.h"
+#include <errno.h>
+#include <stdint.h>
+
+#define DLOG_LEVEL DLOG_INF
+#define DLOG_MODULE "sampler"
+#include "dlog.h"
+
+/* The channels of a period */
+typedef struct smp_group {
+    sampler_chan_t *chans;
+    uint32_t period;    /**< ms, 0 if the group is unused */
+    uint32_t due;       /**< ZTIMER_MSEC time of the next sampling */
+} smp_group_t;
+
+struct sampler {
+    sampler_t *next_smp;
+    recstr_t *next;
+    timex_t (*timef)(void);
+    smp_group_t groups[SAMPLER_GROUPS_MAX];
+};
+
+/* All the instances are served by one scheduler thread. The lock protects the
+ * instance list, the groups and the channel lists. It is released while the
+ * channels are read and their records put, so a slow sensor or stream does not
+ * hold off the registration calls. The scheduler holds the busy lock instead,
+ * which the removals wait for before returning. */
+static kernel_pid_t _smp_pid  = KERNEL_PID_UNDEF;
+static mutex_t      _smp_lock = MUTEX_INIT;
+static mutex_t      _smp_busy = MUTEX_INIT;
+static sampler_t   *_smp_list = NULL;
+
+static void _smp_put(sampler_t *smp, record_t *recs, size_t nb)
+{
+    int res = recstr_putv(smp->next, recs, nb);
+    size_t const taken = res < 0 ? 0 : (size_t)res;
+
+    if (taken < nb) {
+        DWRN("sampler: %u records refused\n", (unsigned)(nb - taken));
+        for (size_t i = taken; i < nb; i++) record_freedata(&recs[i]);
+    }
+}
+
+/* Must be called with both locks held. The lock is released while reading and
+ * putting a batch, the busy lock keeps the channels and the instance valid. */
+static void _smp_sample(sampler_t *smp, smp_group_t *group)
+{
+    timex_t const ts = smp->timef();
+    if (!ts.seconds) {
+        DDBG("sampler: time invalid, sampling skipped\n");
+        return;
+    }
+
+    sampler_chan_t *chans[SAMPLER_BATCH_MAX];
+    record_t recs[SAMPLER_BATCH_MAX];
+    sampler_chan_t *chan = group->chans;
+
+    while (chan) {
+        size_t nb_chans = 0;
+        for (; chan && nb_chans < SAMPLER_BATCH_MAX; chan = chan->next) {
+            chans[nb_chans++] = chan;
+        }
+
+        mutex_unlock(&_smp_lock);
+
+        size_t nb = 0;
+        for (size_t i = 0; i < nb_chans; i++) {
+            record_t *rec = &recs[nb];
+
+            *rec = (record_t){
+                .name      = chans[i]->name,
+                .unit      = chans[i]->unit,
+                .timestamp = ts
+            };
+
+            if (!chans[i]->read(chans[i], rec)) nb++;
+        }
+
+        if (nb) _smp_put(smp, recs, nb);
+
+        mutex_lock(&_smp_lock);
+    }
+}
+
+/* Samples the due groups and returns the ms until the next due one,
+ * UINT32_MAX if there is none. Must be called with both locks held. */
+static uint32_t _smp_run(void)
+{
+    uint32_t wait = UINT32_MAX;
+
+    for (sampler_t *smp = _smp_list; smp; smp = smp->next_smp) {
+        for (unsigned i = 0; i < SAMPLER_GROUPS_MAX; i++) {
+            smp_group_t *group = &smp->groups[i];
+            if (!group->period) continue;
+
+            uint32_t now = ztimer_now(ZTIMER_MSEC);
+
+            if ((int32_t)(group->due - now) <= 0) {
+                _smp_sample(smp, group);
+
+                /* Its last channel may have been removed meanwhile */
+                if (!group->period) continue;
+
+                /* Drift-free: the next sampling is one period after this
+                 * one was due, not after it was done. */
+                group->due += group->period;
+                now = ztimer_now(ZTIMER_MSEC);
+
+                if ((int32_t)(group->due - now) <= 0) {
+                    uint32_t const missed = (now - group->due) / group->period + 1;
+                    DWRN("sampler: %ums period late, %u samplings skipped\n",
+                        (unsigned)group->period, (unsigned)missed);
+                    group->due += missed * group->period;
+                }
+            }
+
+            uint32_t const left = group->due - now;
+            if (left < wait) wait = left;
+        }
+    }
+
+    return wait;
+}
+
+static void *_smp_thread(void *arg)
+{
+    (void)arg;
+
+    /* Only wake-ups are received, one pending is enough */
+    static msg_t msg_queue[2];
+    msg_init_queue(msg_queue, 2);
+    msg_t msg;
+
+    while (1) {
+        mutex_lock(&_smp_busy);
+        mutex_lock(&_smp_lock);
+        uint32_t const wait = _smp_run();
+        mutex_unlock(&_smp_lock);
+        mutex_unlock(&_smp_busy);
+
+        if (wait == UINT32_MAX) {
+            msg_receive(&msg);
+        } else {
+            ztimer_msg_receive_timeout(ZTIMER_MSEC, &msg, wait);
+        }
+    }
+
+    return NULL;
+}
+
+/* Must be called with the lock held */
+static int _smp_thread_init(void)
+{
+    static char smp_stack[SAMPLER_STACKSIZE];
+
+    if (_smp_pid != KERNEL_PID_UNDEF) return 0;
+
+    int res = thread_create(
+        smp_stack,
+        sizeof(smp_stack),
+        SAMPLER_PRIO,
+        0,
+        _smp_thread,
+        NULL,
+        "sampler");
+
+    if (res < 0) return res;
+
+    _smp_pid = res;
+    return 0;
+}
+
+/* Lets the scheduler reconsider its next wake-up */
+static void _smp_wakeup(void)
+{
+    msg_t msg = { 0 };
+    msg_try_send(&msg, _smp_pid);
+}
+
+int sampler_create(sampler_init_t const *init, sampler_t **smp)
+{
+    if (!init || !smp || !init->next || !init->timef) return -EINVAL;
+
+    sampler_t *s = calloc(1, sizeof(*s));
+    if (!s) return -ENOMEM;
+
+    s->next  = init->next;
+    s->timef = init->timef;
+
+    mutex_lock(&_smp_lock);
+
+    int res = _smp_thread_init();
+    if (res) {
+        mutex_unlock(&_smp_lock);
+        DERR("sampler: cannot start the scheduler: %d\n", res);
+        free(s);
+        return res;
+    }
+
+    s->next_smp = _smp_list;
+    _smp_list = s;
+
+    mutex_unlock(&_smp_lock);
+
+    *smp = s;
+
+    return 0;
+}
+
+int sampler_add(sampler_t *smp, sampler_chan_t *chan)
+{
+    if (!smp || !chan || !chan->period || !chan->read) return -EINVAL;
+
+    smp_group_t *group = NULL;
+    smp_group_t *unused = NULL;
+
+    mutex_lock(&_smp_lock);
+
+    for (unsigned i = 0; i < SAMPLER_GROUPS_MAX; i++) {
+        if (smp->groups[i].period == chan->period) {
+            group = &smp->groups[i];
+            break;
+        }
+        if (!smp->groups[i].period && !unused) unused = &smp->groups[i];
+    }
+
+    if (!group) {
+        if (!unused) {
+            mutex_unlock(&_smp_lock);
+            return -ENOSPC;
+        }
+
+        group = unused;
+        group->period = chan->period;
+        group->due    = ztimer_now(ZTIMER_MSEC) + chan->period;
+    }
+
+    chan->next = group->chans;
+    group->chans = chan;
+
+    mutex_unlock(&_smp_lock);
+
+    _smp_wakeup();
+
+    return 0;
+}
+
+int sampler_remove(sampler_t *smp, sampler_chan_t *chan)
+{
+    if (!smp || !chan) return -EINVAL;
+
+    int ret = -ENOENT;
+
+    mutex_lock(&_smp_lock);
+
+    for (unsigned i = 0; i < SAMPLER_GROUPS_MAX && ret; i++) {
+        smp_group_t *group = &smp->groups[i];
+        if (group->period != chan->period) continue;
+
+        for (sampler_chan_t **it = &group->chans; *it; it = &(*it)->next) {
+            if (*it == chan) {
+                *it = chan->next;
+                ret = 0;
+                break;
+            }
+        }
+
+        if (!group->chans) group->period = 0;
+    }
+
+    mutex_unlock(&_smp_lock);
+
+    /* Let a sampling that still reads the channel finish */
+    mutex_lock(&_smp_busy);
+    mutex_unlock(&_smp_busy);
+
+    return ret;
+}
+
+void sampler_delete(sampler_t **smp)
+{
+    if (!smp || !*smp) return;
+
+    mutex_lock(&_smp_lock);
+
+    for (sampler_t **it = &_smp_list; *it; it = &(*it)->next_smp) {
+        if (*it == *smp) {
+            *it = (*smp)->next_smp;
+            break;
+        }
+    }
+
+    mutex_unlock(&_smp_lock);
+
+    /* Let a sampling of the instance finish */
+    mutex_lock(&_smp_busy);
+    mutex_unlock(&_smp_busy);
+
+    free(*smp);
+    *smp = NULL;
+}
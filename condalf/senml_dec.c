@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+#include "senml_dec.h"
+#include "senml_enc.h"
+#include "malloc.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <timex.h>
+
+#define DLOG_LEVEL DLOG_ERR
+#define DLOG_MODULE "senml_dec"
+#include "dlog.h"
+
+enum {
+    SENMLKEY_bn   = -2,
+    SENMLKEY_n    =  0,
+    SENMLKEY_u    =  1,
+    SENMLKEY_v    =  2,
+    SENMLKEY_vs   =  3,
+    SENMLKEY_t    =  6
+};
+
+static void _senml_dec_text(char *dst, size_t size, UsefulBufC s)
+{
+    size_t const len = s.len < size - 1 ? s.len : size - 1;
+    memcpy(dst, s.ptr, len);
+    dst[len] = '\0';
+}
+
+static bool _senml_label_is(QCBORItem const *item, char const *label)
+{
+    return item->label.string.len == strlen(label) &&
+           !memcmp(item->label.string.ptr, label, item->label.string.len);
+}
+
+static int _senml_dec_time(QCBORItem const *item, uint64_t *us)
+{
+    switch (item->uDataType) {
+    case QCBOR_TYPE_DOUBLE:
+        if (item->val.dfnum < 0) return -EBADMSG;
+        *us = item->val.dfnum * US_PER_SEC + 0.5;
+        return 0;
+    case QCBOR_TYPE_INT64:
+        if (item->val.int64 < 0) return -EBADMSG;
+        *us = item->val.int64 * US_PER_SEC;
+        return 0;
+    default:
+        return -EBADMSG;
+    }
+}
+
+int senml_dec_init(senml_dec_t *dec, void const *buf, size_t len)
+{
+    if (!dec || !buf) return -EINVAL;
+
+    memset(dec, 0, sizeof(*dec));
+
+    UsefulBufC const ub = { .ptr = buf, .len = len };
+    QCBORItem item;
+
+    QCBORDecode_Init(&dec->ctx, ub, QCBOR_DECODE_MODE_NORMAL);
+
+    if (QCBORDecode_GetNext(&dec->ctx, &item) != QCBOR_SUCCESS ||
+        item.uDataType != QCBOR_TYPE_ARRAY) {
+        return -EBADMSG;
+    }
+
+    /* Indefinite length arrays are reported with UINT16_MAX entries */
+    if (item.val.uCount == UINT16_MAX) return -EBADMSG;
+
+    dec->left = item.val.uCount;
+
+    return 0;
+}
+
+int senml_dec_next(senml_dec_t *dec, record_t *rec)
+{
+    if (!dec || !rec) return -EINVAL;
+
+    if (dec->run_left) {
+        *rec = dec->run;
+        dec->run_t += dec->run_step;
+        dec->run_left--;
+        /* The last one gets the remainder of the spacing */
+        if (!dec->run_left) dec->run_t = dec->run_end;
+        rec->timestamp = timex_from_uint64(dec->run_t);
+        return 0;
+    }
+
+    while (dec->left) {
+        QCBORItem item;
+
+        dec->left--;
+
+        if (QCBORDecode_GetNext(&dec->ctx, &item) != QCBOR_SUCCESS ||
+            item.uDataType != QCBOR_TYPE_MAP) {
+            return -EBADMSG;
+        }
+
+        record_t r = { 0 };
+        UsefulBufC name = { .ptr = "", .len = 0 };
+        UsefulBufC str = { 0 };
+        bool has_v = false;
+        uint64_t t = 0;
+        uint64_t rt = 0;
+        uint32_t rc = 1;
+
+        for (unsigned i = item.val.uCount; i; i--) {
+            if (QCBORDecode_GetNext(&dec->ctx, &item) != QCBOR_SUCCESS) return -EBADMSG;
+
+            /* Our encoder never nests within a record */
+            if (item.uDataType == QCBOR_TYPE_MAP ||
+                item.uDataType == QCBOR_TYPE_ARRAY) return -EBADMSG;
+
+            if (item.uLabelType == QCBOR_TYPE_TEXT_STRING) {
+                if (_senml_label_is(&item, SENML_LABEL_RC)) {
+                    if (item.uDataType != QCBOR_TYPE_INT64 ||
+                        item.val.int64 < 1 || item.val.int64 > UINT32_MAX) {
+                        return -EBADMSG;
+                    }
+                    rc = item.val.int64;
+                } else if (_senml_label_is(&item, SENML_LABEL_RT)) {
+                    if (_senml_dec_time(&item, &rt)) return -EBADMSG;
+                } else {
+                    DDBG("unknown label ignored\n");
+                }
+                continue;
+            }
+
+            if (item.uLabelType != QCBOR_TYPE_INT64) continue;
+
+            switch (item.label.int64) {
+            case SENMLKEY_bn:
+                if (item.uDataType != QCBOR_TYPE_TEXT_STRING) return -EBADMSG;
+                _senml_dec_text(dec->bn, sizeof(dec->bn), item.val.string);
+                break;
+
+            case SENMLKEY_n:
+                if (item.uDataType != QCBOR_TYPE_TEXT_STRING) return -EBADMSG;
+                name = item.val.string;
+                break;
+
+            case SENMLKEY_u:
+                if (item.uDataType != QCBOR_TYPE_TEXT_STRING) return -EBADMSG;
+                r.unit = senml_unit_parse(item.val.string);
+                break;
+
+            case SENMLKEY_t:
+                if (_senml_dec_time(&item, &t)) return -EBADMSG;
+                break;
+
+            case SENMLKEY_v:
+            case SENMLKEY_vs:
+                has_v = true;
+
+                if (item.uDataType == QCBOR_TYPE_INT64 &&
+                    item.val.int64 >= INT32_MIN && item.val.int64 <= INT32_MAX) {
+                    r.type = RECORDTYPE_I32;
+                    r.i32 = item.val.int64;
+                } else if (item.uDataType == QCBOR_TYPE_INT64 &&
+                           item.val.int64 > 0 && item.val.int64 <= UINT32_MAX) {
+                    r.type = RECORDTYPE_U32;
+                    r.u32 = item.val.int64;
+                } else if (item.uDataType == QCBOR_TYPE_TEXT_STRING) {
+                    r.type = RECORDTYPE_STRING;
+                    str = item.val.string;
+                } else {
+                    /* No record type for it */
+                    has_v = false;
+                }
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        if (!has_v) {
+            DDBG("record without value skipped\n");
+            continue;
+        }
+
+        snprintf(dec->name, sizeof(dec->name), "%s%.*s",
+            dec->bn, (int)name.len, (char const *)name.ptr);
+
+        r.name = dec->name;
+        r.timestamp = timex_from_uint64(t);
+
+        if (r.type == RECORDTYPE_STRING) {
+            r.str = malloc(str.len + 1);
+            if (!r.str) return -ENOMEM;
+            _senml_dec_text(r.str, str.len + 1, str);
+        } else if (rc > 1 && rt > t) {
+            dec->run      = r;
+            dec->run_left = rc - 1;
+            dec->run_t    = t;
+            dec->run_step = (rt - t) / (rc - 1);
+            dec->run_end  = rt;
+        }
+
+        *rec = r;
+        return 0;
+    }
+
+    return -ENODATA;
+}
@@ -12,6 +12,7 @@
 #include <timex.h>
 
 #define DLOG_LEVEL DLOG_ERR
+#define DLOG_MODULE "senml_enc"
 #include "dlog.h"
 
 enum {
@@ -94,6 +95,18 @@ static char const *const senml_units[RECORDUNIT_ENUMSIZE] = {
     [RECORDUNIT_S_per_m] =                "S/m"
 };
 
+int senml_unit_parse(UsefulBufC unit)
+{
+    for (unsigned i = RECORDUNIT_NONE + 1; i < RECORDUNIT_ENUMSIZE; i++) {
+        if (strlen(senml_units[i]) == unit.len &&
+            !memcmp(senml_units[i], unit.ptr, unit.len)) {
+            return i;
+        }
+    }
+
+    return RECORDUNIT_NONE;
+}
+
 int senml_enc_init(senml_enc_t *enc, char *buf, size_t size, record_base_t const *base)
 {
     if (!enc) return -EINVAL;
@@ -102,6 +115,7 @@ int senml_enc_init(senml_enc_t *enc, char *buf, size_t size, record_base_t const
 
     enc->buf.ptr = buf;
     enc->buf.len = size;
+    enc->bn = base ? base->name : NULL;
 
     QCBOREncodeContext *const qenc = &enc->cbor_ctx;
 
@@ -139,7 +153,75 @@ int senml_enc_init(senml_enc_t *enc, char *buf, size_t size, record_base_t const
     return 0;
 }
 
+static bool _bn_equal(char const *a, char const *b)
+{
+    if (a == b) return true;
+    if (!a || !b) return false;
+    return !strcmp(a, b);
+}
+
 int senml_enc_put(senml_enc_t *enc, record_t const *rec)
+{
+    if (!enc) return -EINVAL;
+    return senml_enc_put_bn(enc, rec, enc->bn);
+}
+
+int senml_enc_put_bn(senml_enc_t *enc, record_t const *rec, char const *bn)
+{
+    return senml_enc_put_rep(enc, rec, bn, NULL);
+}
+
+static void _senml_enc_rep(QCBOREncodeContext *qenc, senml_rep_t const *rep)
+{
+    if (!rep || rep->cnt <= 1) return;
+
+    QCBOREncode_AddUInt64ToMap(qenc, SENML_LABEL_RC, rep->cnt);
+
+    double const last = timex_uint64(rep->last) / (double)US_PER_SEC;
+    QCBOREncode_AddDoubleToMap(qenc, SENML_LABEL_RT, last);
+}
+
+size_t senml_enc_rep_len(senml_rep_t const *rep)
+{
+    if (!rep || rep->cnt <= 1) return 0;
+
+    /* Encode the fields in an otherwise empty map, without a buffer */
+    QCBOREncodeContext qenc;
+    UsefulBufC out;
+
+    QCBOREncode_Init(&qenc, (UsefulBuf){ .ptr = NULL, .len = 64 });
+    QCBOREncode_OpenMap(&qenc);
+    _senml_enc_rep(&qenc, rep);
+    QCBOREncode_CloseMap(&qenc);
+
+    if (QCBOREncode_Finish(&qenc, &out) != QCBOR_SUCCESS) return 0;
+
+    /* Minus the map header */
+    return out.len - 1;
+}
+
+int senml_enc_grow(senml_enc_t *enc, size_t len)
+{
+    if (!enc || enc->buf.ptr) return -EINVAL;
+
+    QCBOREncodeContext *const qenc = &enc->cbor_ctx;
+    /* Nothing is copied without a buffer, only the size is tracked */
+    UsefulOutBuf_AppendData(&qenc->OutBuf, NULL, len);
+
+    switch (QCBOREncode_GetErrorState(qenc)) {
+    case QCBOR_SUCCESS:
+        return 0;
+
+    case QCBOR_ERR_BUFFER_TOO_SMALL:
+        return -ENOSPC;
+
+    default:
+        return -EINVAL;
+    }
+}
+
+int senml_enc_put_rep(senml_enc_t *enc, record_t const *rec, char const *bn,
+                      senml_rep_t const *rep)
 {
     if (!enc || !rec) {
         DERR("invalid arguments!\n");
@@ -149,6 +231,16 @@ int senml_enc_put(senml_enc_t *enc, record_t const *rec)
     QCBOREncodeContext *const qenc = &enc->cbor_ctx;
     QCBOREncode_OpenMap(qenc);
 
+    if (!_bn_equal(enc->bn, bn)) {
+        /* An empty base name resets it for the following records */
+        UsefulBufC const _bname = {
+            .ptr = bn ? bn : "",
+            .len = bn ? strlen(bn) : 0
+        };
+        QCBOREncode_AddTextToMapN(qenc, SENMLKEY_bn, _bname);
+        enc->bn = bn;
+    }
+
     UsefulBufC const name = {.ptr = rec->name, .len = strlen(rec->name)};
     QCBOREncode_AddTextToMapN(qenc, SENMLKEY_n, name);
 
@@ -187,8 +279,38 @@ int senml_enc_put(senml_enc_t *enc, record_t const *rec)
     {
         UsefulBufC const val = {.ptr = rec->str, .len = strlen(rec->str)};
         QCBOREncode_AddTextToMapN(qenc, SENMLKEY_v, val);
+        break;
+    }
+
+    case RECORDTYPE_HIST:
+    {
+        /* The sum, and the data value wrapping the CBOR array
+         * [lo, width, flags, bucket counts...] */
+        record_hist_t const *h = rec->hist;
+        QCBOREncode_AddInt64ToMapN(qenc, SENMLKEY_s, h->sum);
+
+        QCBOREncode_BstrWrapInMapN(qenc, SENMLKEY_vd);
+        QCBOREncode_OpenArray(qenc);
+        QCBOREncode_AddInt64(qenc, h->lo);
+        QCBOREncode_AddUInt64(qenc, h->width);
+        QCBOREncode_AddUInt64(qenc, h->flags);
+        for (unsigned i = 0; i < h->nb; i++) {
+            QCBOREncode_AddUInt64(qenc, h->buckets[i]);
+        }
+        QCBOREncode_CloseArray(qenc);
+        QCBOREncode_CloseBstrWrap(qenc, NULL);
+        break;
     }
+
+    case RECORDTYPE_DATA:
+    {
+        UsefulBufC const val = {.ptr = rec->data->bytes, .len = rec->data->len};
+        QCBOREncode_AddBytesToMapN(qenc, SENMLKEY_vd, val);
+        break;
     }
+    }
+
+    _senml_enc_rep(qenc, rep);
 
     QCBOREncode_CloseMap(qenc);
 
@@ -229,3 +351,76 @@ int senml_enc_close(senml_enc_t *enc, size_t *enc_len)
     if (enc_len) *enc_len = outb.len;
     return retval;
 }
+
+/* CBOR initial bytes used by the pack manipulation functions */
+#define CBOR_MAJOR_MASK     0xE0
+#define CBOR_INFO_MASK      0x1F
+#define CBOR_ARRAY          0x80
+#define CBOR_MAP_1          0xA1
+#define CBOR_NEGINT_1       0x21 /* -2, i.e. SENMLKEY_bn */
+#define CBOR_TEXT_EMPTY     0x60
+#define CBOR_INFO_UINT8     24
+
+int senml_pack_hdr_parse(void const *buf, size_t len, senml_pack_hdr_t *hdr)
+{
+    uint8_t const *p = buf;
+
+    if (!p || !hdr || len < 1) return -EINVAL;
+    if ((p[0] & CBOR_MAJOR_MASK) != CBOR_ARRAY) return -EINVAL;
+
+    uint8_t const info = p[0] & CBOR_INFO_MASK;
+    size_t cnt = 0;
+    size_t hdr_len = 1;
+
+    if (info < CBOR_INFO_UINT8) {
+        cnt = info;
+    } else if (info <= CBOR_INFO_UINT8 + 2) {
+        /* 1, 2 or 4 bytes of count follow */
+        hdr_len += 1 << (info - CBOR_INFO_UINT8);
+        if (len < hdr_len) return -EINVAL;
+
+        for (size_t i = 1; i < hdr_len; i++) cnt = (cnt << 8) | p[i];
+    } else {
+        /* 64-bit or indefinite length, never produced by this encoder */
+        return -EINVAL;
+    }
+
+    hdr->cnt = cnt;
+    hdr->hdr_len = hdr_len;
+    hdr->has_bn = len >= hdr_len + 2 &&
+                  p[hdr_len] == CBOR_MAP_1 &&
+                  p[hdr_len + 1] == CBOR_NEGINT_1;
+
+    return 0;
+}
+
+size_t senml_pack_hdr_put(void *buf, size_t cnt)
+{
+    uint8_t *p = buf;
+    size_t nb;
+
+    if (cnt < CBOR_INFO_UINT8) {
+        p[0] = CBOR_ARRAY | cnt;
+        return 1;
+    }
+
+    if (cnt <= 0xFF) nb = 1;
+    else if (cnt <= 0xFFFF) nb = 2;
+    else nb = 4;
+
+    p[0] = CBOR_ARRAY | (CBOR_INFO_UINT8 + (nb >> 1));
+    for (size_t i = nb; i > 0; i--, cnt >>= 8) p[i] = cnt & 0xFF;
+
+    return nb + 1;
+}
+
+size_t senml_pack_bn_reset(void *buf)
+{
+    uint8_t *p = buf;
+
+    p[0] = CBOR_MAP_1;
+    p[1] = CBOR_NEGINT_1;
+    p[2] = CBOR_TEXT_EMPTY;
+
+    return SENML_PACK_BN_RESET_LEN;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+#include "slotring.h"
+
+static slotring_slot_t *_slot(slotring_t *ring, unsigned idx)
+{
+    return (slotring_slot_t *)((char *)ring->slots + idx * ring->slot_size);
+}
+
+void *slotring_claim(slotring_t *ring, unsigned *pos)
+{
+    unsigned p = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    while (1) {
+        unsigned const idx = p & (ring->len - 1);
+        slotring_slot_t *slot = _slot(ring, idx);
+        unsigned const seq = atomic_load_explicit(&slot->seq,
+                                                  memory_order_acquire) + idx;
+        int const diff = (int)(seq - p);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &p, p + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                *pos = p;
+                return slot;
+            }
+        } else if (diff < 0) {
+            /* a lap behind: full */
+            atomic_fetch_add(&ring->dropped, 1);
+            return NULL;
+        } else {
+            p = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+}
+
+void slotring_publish(slotring_t *ring, void *slot, unsigned pos)
+{
+    unsigned const idx = pos & (ring->len - 1);
+    atomic_store_explicit(&((slotring_slot_t *)slot)->seq, pos + 1 - idx,
+                          memory_order_release);
+}
+
+void *slotring_peek(slotring_t *ring)
+{
+    unsigned const idx = ring->tail & (ring->len - 1);
+    slotring_slot_t *slot = _slot(ring, idx);
+    unsigned const seq = atomic_load_explicit(&slot->seq,
+                                              memory_order_acquire) + idx;
+
+    return seq == ring->tail + 1 ? slot : NULL;
+}
+
+void slotring_release(slotring_t *ring, void *slot)
+{
+    unsigned const idx = ring->tail & (ring->len - 1);
+    atomic_store_explicit(&((slotring_slot_t *)slot)->seq,
+                          ring->tail + ring->len - idx, memory_order_release);
+    ring->tail++;
+}
@@ -15,6 +15,7 @@
 #include <fcntl.h>
 
 #define DLOG_LEVEL DLOG_ERR
+#define DLOG_MODULE "vstorage"
 #include "dlog.h"
 
 #if DLOG_LEVEL >= DLOG_DBG
@@ -99,7 +100,7 @@ static off_t _lseek (vfs_file_t *filp, off_t off, int whence)
 
     _check_inv(filp);
 
-    return 0;
+    return off;
 }
 
 static ssize_t _read(vfs_file_t *filp, void *dest, size_t nbytes)
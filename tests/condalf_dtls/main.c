@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @file
+ * @brief ConDaLF DTLS transfer test
+ *
+ * Sends two packs to a DTLS backend stand-in on the same node and checks that
+ * gcoap's session is reused, i.e. that a single handshake is counted.
+ * */
+
+/* ConDaLF */
+#include "networking.h"
+#include "vstorage.h"
+
+/* RIOT */
+#include "net/coap.h"
+#include "net/credman.h"
+#include "net/nanocoap.h"
+#include "net/sock/dtls.h"
+#include "net/sock/udp.h"
+#include "thread.h"
+#include "vfs.h"
+
+/* STD */
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_PORT       5685
+#define TEST_PSK_ID     "condalf_test"
+#define TEST_PSK_KEY    "secretPSK"
+
+static credman_credential_t const _cred = {
+    .type = CREDMAN_TYPE_PSK,
+    .tag  = CONFIG_GCOAP_DTLS_CREDENTIAL_TAG,
+    .params = {
+        .psk = {
+            .id  = { .s = TEST_PSK_ID, .len = sizeof(TEST_PSK_ID) - 1 },
+            .key = { .s = TEST_PSK_KEY, .len = sizeof(TEST_PSK_KEY) - 1 },
+        }
+    }
+};
+
+static sock_udp_t  _srv_udp;
+static sock_dtls_t _srv_dtls;
+static char _srv_stack[THREAD_STACKSIZE_MAIN];
+
+/* Backend stand-in, acknowledges every PUT with 2.04 */
+static void *_srv_thread(void *arg)
+{
+    (void)arg;
+
+    sock_dtls_session_t session;
+    uint8_t buf[CONFIG_GCOAP_PDU_BUF_SIZE];
+
+    while (1) {
+        ssize_t res = sock_dtls_recv(&_srv_dtls, &session, buf, sizeof(buf),
+                                     SOCK_NO_TIMEOUT);
+        /* the session is up, the request follows */
+        if (res == -SOCK_DTLS_HANDSHAKE || res <= 0) continue;
+
+        coap_pkt_t pdu;
+        if (coap_parse(&pdu, buf, res) < 0) continue;
+
+        res = coap_build_reply(&pdu, COAP_CODE_CHANGED, buf, sizeof(buf), 0);
+        if (res > 0) sock_dtls_send(&_srv_dtls, &session, buf, res, SOCK_NO_TIMEOUT);
+    }
+
+    return NULL;
+}
+
+static int _send(void)
+{
+    static char const pack[] = "condalf dtls test pack";
+    char addr[] = "::1";
+    char path[] = "/test";
+
+    rem_res_t const res = {
+        .address      = addr,
+        .port         = TEST_PORT,
+        .res_location = path
+    };
+
+    vstorfile_init_t vinit = {
+        .buf    = (char *)pack,
+        .bufsiz = sizeof(pack) - 1,
+        .flags  = VSTORF_BUF_HAS_DATA
+    };
+
+    int fd = vstorfile_open(&vinit);
+    if (fd < 0) return fd;
+
+    int ret = net_send(&res, fd, NULL);
+    vfs_close(fd);
+
+    return ret;
+}
+
+int main(void)
+{
+    net_subsys_init_t init = {
+        .dtls_cred = &_cred
+    };
+
+    int res = net_subsys_init(&init);
+    if (res) {
+        printf("cannot init networking: %d\n", res);
+        return 1;
+    }
+
+    sock_udp_ep_t local = SOCK_IPV6_EP_ANY;
+    local.port = TEST_PORT;
+
+    if (sock_udp_create(&_srv_udp, &local, NULL, 0) < 0 ||
+        sock_dtls_create(&_srv_dtls, &_srv_udp, _cred.tag, SOCK_DTLS_1_2,
+                         SOCK_DTLS_SERVER) < 0) {
+        puts("cannot create the backend stand-in");
+        return 1;
+    }
+
+    thread_create(_srv_stack, sizeof(_srv_stack), THREAD_PRIORITY_MAIN - 1,
+                  THREAD_CREATE_STACKTEST, _srv_thread, NULL, "backend");
+
+    /* the second transfer must reuse the session of the first */
+    printf("send 1: %d\n", _send());
+    printf("send 2: %d\n", _send());
+
+    net_dtls_stats_t stats;
+    net_dtls_get_stats(&stats);
+    printf("handshakes: %" PRIu32 "\n", stats.nb_handshakes);
+
+    puts(stats.nb_handshakes == 1 ? "SUCCESS" : "FAILURE");
+
+    return 0;
+}
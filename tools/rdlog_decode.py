@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2021 Mihai Renea <mihai.renea@fu-berlin.de>
+#
+# This file is subject to the terms and conditions of the GNU Lesser
+# General Public License v2.1. See the file LICENSE in the top level
+# directory for more details.
+
+"""Rebuild the text of binary RDLOG records (RDLOG_BINARY = 1).
+
+A binary log holds the address of its format string in the firmware, followed
+by the raw arguments. The format strings are looked up in the ELF file of the
+very build that sent the logs.
+
+Reads one log per line from stdin: the data value (vd) of the record, base64
+as in SenML JSON, or hex with --hex. Anything before the last whitespace
+separated field, e.g. a timestamp and the level, is printed as is.
+
+    tools/rdlog_decode.py bin/esp32-wroom-32/usecase.elf < logs.txt
+"""
+
+import argparse
+import base64
+import binascii
+import re
+import struct
+import sys
+
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+CONVERSION = re.compile(
+    r'%(?P<flags>[-+ #0]*)(?P<width>\*|\d*)(?:\.(?P<prec>\*|\d*))?'
+    r'(?P<len>hh|h|ll|l|L|j|z|t)?(?P<conv>[diuoxXcpsfFeEgGaA%])')
+
+
+class Elf:
+    """Minimal ELF reader, maps addresses of loaded sections to file data."""
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.data = f.read()
+
+        if self.data[:4] != b'\x7fELF':
+            raise ValueError('%s: not an ELF file' % path)
+
+        is64 = self.data[4] == 2
+        end = '<' if self.data[5] == 1 else '>'
+
+        if is64:
+            shoff, = struct.unpack_from(end + 'Q', self.data, 0x28)
+            shentsize, shnum = struct.unpack_from(end + 'HH', self.data, 0x3a)
+            shdr = end + 'IIQQQQIIQQ'
+        else:
+            shoff, = struct.unpack_from(end + 'I', self.data, 0x20)
+            shentsize, shnum = struct.unpack_from(end + 'HH', self.data, 0x2e)
+            shdr = end + 'IIIIIIIIII'
+
+        self.sections = []
+        for i in range(shnum):
+            (_, sh_type, sh_flags, sh_addr, sh_offset, sh_size,
+             *_) = struct.unpack_from(shdr, self.data, shoff + i * shentsize)
+            if sh_flags & SHF_ALLOC and sh_type != SHT_NOBITS and sh_size:
+                self.sections.append((sh_addr, sh_offset, sh_size))
+
+    def string(self, addr):
+        for sh_addr, sh_offset, sh_size in self.sections:
+            if sh_addr <= addr < sh_addr + sh_size:
+                start = sh_offset + addr - sh_addr
+                stop = self.data.index(b'\0', start, sh_offset + sh_size)
+                return self.data[start:stop].decode(errors='replace')
+        return None
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def uint(self):
+        val = shift = 0
+        while True:
+            if self.pos >= len(self.data):
+                raise EOFError
+            byte = self.data[self.pos]
+            self.pos += 1
+            val |= (byte & 0x7f) << shift
+            shift += 7
+            if not byte & 0x80:
+                return val
+
+    def int(self):
+        val = self.uint()
+        return (val >> 1) ^ -(val & 1)
+
+    def double(self):
+        if self.pos + 8 > len(self.data):
+            raise EOFError
+        val, = struct.unpack_from('<d', self.data, self.pos)
+        self.pos += 8
+        return val
+
+    def str(self):
+        n = self.uint()
+        if self.pos + n > len(self.data):
+            raise EOFError
+        val = self.data[self.pos:self.pos + n].decode(errors='replace')
+        self.pos += n
+        return val
+
+
+def decode(elf, data):
+    rd = Reader(data)
+    fmt = elf.string(rd.uint())
+    if fmt is None:
+        return '<unknown format, wrong ELF file?>'
+
+    out = []
+    last = 0
+
+    for m in CONVERSION.finditer(fmt):
+        out.append(fmt[last:m.start()])
+        last = m.end()
+
+        conv = m.group('conv')
+        if conv == '%':
+            out.append('%')
+            continue
+
+        try:
+            spec, args = '%' + m.group('flags'), []
+            for part, sep in (('width', ''), ('prec', '.')):
+                val = m.group(part)
+                if val is None:
+                    continue
+                if val == '*':
+                    args.append(rd.int())
+                spec += sep + val
+
+            if conv in 'di':
+                args.append(rd.int())
+            elif conv in 'uoxXc':
+                args.append(rd.uint())
+                if conv == 'u':
+                    conv = 'd'
+            elif conv == 'p':
+                args.append(rd.uint())
+                spec, conv = '%#', 'x'
+            elif conv == 's':
+                args.append(rd.str())
+            else:
+                args.append(rd.double())
+        except EOFError:
+            out.append('<?>')
+            continue
+
+        out.append((spec + conv) % tuple(args))
+
+    out.append(fmt[last:])
+    return ''.join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('elf', help='ELF file of the firmware')
+    parser.add_argument('--hex', action='store_true',
+                        help='the data values are hex instead of base64')
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+
+    for line in sys.stdin:
+        fields = line.rsplit(None, 1)
+        if not fields:
+            continue
+
+        prefix = fields[0] + ' ' if len(fields) > 1 else ''
+
+        try:
+            if args.hex:
+                data = binascii.unhexlify(fields[-1])
+            else:
+                vd = fields[-1]
+                data = base64.urlsafe_b64decode(vd + '=' * (-len(vd) % 4))
+            text = decode(elf, data)
+        except (ValueError, binascii.Error, EOFError):
+            text = '<malformed: %s>' % fields[-1]
+
+        print(prefix + text)
+
+
+if __name__ == '__main__':
+    main()
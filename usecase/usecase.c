@@ -14,6 +14,8 @@
 
 /* ConDaLF */
 #include "logging.h"
+#include "recfilt.h"
+#include "sampler.h"
 
 /* RIOT */
 #include "periph/adc.h"
@@ -27,10 +29,15 @@
 /* STD */
 #include <assert.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 #if CONDALF_USE_PUBLISHER == 1
 /* ConDaLF */
 #include "publisher.h"
+#include "remconf.h"
+#if CONDALF_USE_DTLS == 1
+#include "networking.h"
+#endif
 #endif
 
 #if CONDALF_USE_LTB == 1
@@ -46,6 +53,8 @@
 #define DLOG_TIME (sntp_get_unix_usec() / US_PER_SEC)
 /* Define the logging level for the DLOG calls. DLOG_DBG enables all of them. */
 #define DLOG_LEVEL DLOG_DBG
+/* Name under which the levels can be changed at runtime, see dlog_set_level() */
+#define DLOG_MODULE "usecase"
 /* Define the logging level for the RDLOG calls. Only info, warning and error
  * logs will be sent, but not debugging. */
 #define RDLOG_LEVEL DLOG_INF
@@ -56,6 +65,8 @@
 
 #define LIGHT_ADC_LINE 10 // ESP32 gpio 32
 #define TEMP_ADC_LINE 11 // ESP32 gpio 33
+/* temperature from which on the samples are sent urgently, in °C */
+#define TEMP_ALARM 50
 
 #define TIME_UPDATE_PRIO (THREAD_PRIORITY_MAIN + 1)
 static char time_update_stack[THREAD_STACKSIZE_MAIN];
@@ -65,7 +76,35 @@ static bool volatile must_stop = false;
 
 #define ENCODING_BUFSIZE  2048
 #define ENCODING_QUEUELEN 64
-#define PROBING_PERIOD (5 * US_PER_SEC)
+#define PROBING_PERIOD 5 /* seconds */
+/* how often to check for a new configuration, in seconds */
+#define REMCONF_PERIOD (10 * 60)
+
+/* Initial sizes of the data logger, and current sampling period, may be changed
+ * by the backend. The logger reports its current sizes, see logg_get_stats(). */
+static size_t   logg_queue_len = ENCODING_QUEUELEN;
+static size_t   logg_buf_size  = ENCODING_BUFSIZE;
+static uint32_t probing_period = PROBING_PERIOD;
+
+static int read_light(sampler_chan_t *chan, record_t *rec);
+static int read_temp(sampler_chan_t *chan, record_t *rec);
+
+/* The sensor channels, sampled together by the sampler */
+static sampler_t *sampler = NULL;
+static sampler_chan_t light_chan = {
+    /* no way our light diode gives us any accurate values, so we'll go
+     * for percentile light. Anyway, InfluxDB ignores it. */
+    .name   = "light",
+    .unit   = RECORDUNIT_percent,
+    .period = PROBING_PERIOD * MS_PER_SEC,
+    .read   = read_light
+};
+static sampler_chan_t temp_chan = {
+    .name   = "temp",
+    .unit   = RECORDUNIT_Cel,
+    .period = PROBING_PERIOD * MS_PER_SEC,
+    .read   = read_temp
+};
 
 #if CONDALF_USE_LTB == 1
 
@@ -111,7 +150,132 @@ static int fs_setup(void)
 
 #endif
 
-/* Provides time-stamps for the RDLOG calls */
+#if CONDALF_USE_PUBLISHER == 1 && defined(USECASE_BACKEND_CONF_RESSOURCE)
+/* Re-add the channels with a new period, to be sampled together again */
+static int sampling_set_period(uint32_t period)
+{
+    sampler_remove(sampler, &light_chan);
+    sampler_remove(sampler, &temp_chan);
+    light_chan.period = period * MS_PER_SEC;
+    temp_chan.period  = period * MS_PER_SEC;
+
+    int res = sampler_add(sampler, &light_chan);
+    if (!res) res = sampler_add(sampler, &temp_chan);
+
+    return res;
+}
+
+/* Fetch the configuration from the backend and apply what it contains */
+static void remconf_update(transdrv_t *conf_recv, recstr_t *logger)
+{
+    remconf_t conf;
+    uint32_t val;
+
+    int res = remconf_fetch(conf_recv, &conf);
+    if (res) {
+        RDWRN("cannot fetch configuration: %d", res);
+        return;
+    }
+
+    /* Autotuning moves the sizes, compare with the ones in use */
+    logg_stats_t stats;
+    res = logg_get_stats(logger, &stats);
+    if (res) {
+        RDWRN("cannot get logger sizes: %d", res);
+        stats.record_queue_size = logg_queue_len;
+        stats.encoding_buf_size = logg_buf_size;
+    }
+
+    size_t queue_len = stats.record_queue_size;
+    size_t buf_size  = stats.encoding_buf_size;
+
+    if (remconf_get(&conf, REMCONF_KEY_LOGG_QUEUE_LEN, &val)) queue_len = val;
+    if (remconf_get(&conf, REMCONF_KEY_LOGG_BUF_SIZE, &val))  buf_size  = val;
+
+    if (queue_len != stats.record_queue_size ||
+        buf_size != stats.encoding_buf_size) {
+        res = logg_resize(logger, queue_len, buf_size);
+        if (res) {
+            RDWRN("cannot resize logger to %u/%u: %d",
+                (unsigned)queue_len, (unsigned)buf_size, res);
+        } else {
+            RDINF("logger resized to %u/%u",
+                (unsigned)queue_len, (unsigned)buf_size);
+        }
+    }
+
+#if CONDALF_USE_LTB == 1
+    if (remconf_get(&conf, REMCONF_KEY_LTB_FILES_LIM, &val) && val) {
+        ltb_set_nb_files_lim(val);
+    }
+#endif
+
+    if (remconf_get(&conf, REMCONF_KEY_SAMPLING_PERIOD, &val) && val &&
+        val != probing_period) {
+        res = sampling_set_period(val);
+        if (res) {
+            RDERR("cannot set sampling period to %us: %d", (unsigned)val, res);
+
+            /* Keep sampling with the previous period */
+            res = sampling_set_period(probing_period);
+            if (res) RDERR("sampling stopped: %d", res);
+        } else {
+            probing_period = val;
+            RDINF("sampling period set to %us", (unsigned)val);
+        }
+    }
+
+    /* Raise the diagnostics sent while investigating a fault, lower them
+     * again afterwards. Capped by the RDLOG_LEVEL of each module. */
+    if (remconf_get(&conf, REMCONF_KEY_RDLOG_LEVEL, &val)) {
+        dlog_set_level(NULL, val, DLOGF_REMOTE);
+    }
+}
+#endif
+
+static int read_light(sampler_chan_t *chan, record_t *rec)
+{
+    (void)chan;
+
+    int32_t sample = adc_sample(LIGHT_ADC_LINE, ADC_RES_10BIT);
+    if (sample < 0) return -EIO;
+
+    /* percentile light */
+    sample = sample * 100 / 1024;
+    DDBG("ADC: light=%i%%\n", sample);
+
+    rec->type = RECORDTYPE_I32;
+    rec->i32  = sample;
+
+    return 0;
+}
+
+static int read_temp(sampler_chan_t *chan, record_t *rec)
+{
+    (void)chan;
+
+    int32_t sample = adc_sample(TEMP_ADC_LINE, ADC_RES_10BIT);
+    if (sample < 0) return -EIO;
+
+    /* voltage in mV */
+    sample = sample * 3300 / 1024;
+    /* LM35: 10mv / degree Celsius */
+    sample = sample / 10;
+    /* for some mysterious reason, the LM35 is outputting exactly half the
+     * real temperature.
+     * The ADC measures 0 for GND and 1023 for 3.3V */
+    sample *= 2;
+    DDBG("ADC: temp=%i°C\n", sample);
+
+    rec->type = RECORDTYPE_I32;
+    rec->i32  = sample;
+    /* An overheating alarm must not wait for the pack to fill up */
+    if (sample >= TEMP_ALARM) rec->flags |= RECORDF_URGENT;
+
+    return 0;
+}
+
+/* Provides time-stamps for the RDLOG calls and the samples */
 timex_t rdlog_timef(void)
 {
     uint64_t unixtime = time_is_set ? sntp_get_unix_usec() : 0;
@@ -178,13 +342,21 @@ int usecase(void)
     static_assert(CONDALF_USE_PUBLISHER == 1 || CONDALF_USE_LTB == 1,
         "Please enable at least the ConDaLF publisher or LTB.");
 
+#if DLOG_ASYNC == 1
+    if (dlog_async_init()) {
+        puts("cannot start the asynchronous log output");
+    }
+#endif
+
     DINF("ConDaLF, running on %s.\n", RIOT_BOARD);
     DINF("\n\tCONDALF_USE_PUBLISHER=%d\n"
            "\tCONDALF_USE_LTB=%d\n"
-           "\tCONDALF_USE_RDLOG=%d\n",
+           "\tCONDALF_USE_RDLOG=%d\n"
+           "\tCONDALF_USE_DTLS=%d\n",
          CONDALF_USE_PUBLISHER,
          CONDALF_USE_LTB,
-         CONDALF_USE_RDLOG);
+         CONDALF_USE_RDLOG,
+         CONDALF_USE_DTLS);
 
     int res = thread_create(
         time_update_stack,
@@ -210,12 +382,65 @@ int usecase(void)
         .res_location = USECASE_BACKEND_RESSOURCE
     };
 
+#if CONDALF_USE_DTLS == 1
+    /* The backend authenticates us by a pre-shared key. The DTLS session is
+     * kept by gcoap across the transfers, so the handshake is done only once
+     * per backend and not for every pack. */
+    static credman_credential_t const dtls_cred = {
+        .type = CREDMAN_TYPE_PSK,
+        .tag  = CONFIG_GCOAP_DTLS_CREDENTIAL_TAG,
+        .params = {
+            .psk = {
+                .id  = { .s = USECASE_DTLS_PSK_ID,
+                         .len = sizeof(USECASE_DTLS_PSK_ID) - 1 },
+                .key = { .s = USECASE_DTLS_PSK_KEY,
+                         .len = sizeof(USECASE_DTLS_PSK_KEY) - 1 },
+            }
+        }
+    };
+
+    net_subsys_init_t net_init = {
+        .dtls_cred = &dtls_cred
+    };
+
+    res = net_subsys_init(&net_init);
+    if (res) {
+        DERR("cannot init networking: %s\n", strerror(-res));
+        return -1;
+    }
+#endif
+
+    /* When publishing directly, data packs queued at the same time are merged
+     * into a single transfer. */
+    publ_init_t const publ_init = {
+        .rem_res      = &rem_res,
+        .retry_cnt    = 1,
+        .coalesce_len = ENCODING_BUFSIZE
+    };
+
     transdrv_t *sender = NULL;
-    res = publisher_init(&sender, &rem_res, 1);
+    res = publisher_create(&sender, &publ_init);
     if (res) {
         DERR("cannot init sender: %s\n", strerror(res));
         return -1;
     }
+
+#ifdef USECASE_BACKEND_CONF_RESSOURCE
+    /* A second publisher, only used to fetch the configuration. It shares the
+     * server endpoint (and its concurrency limit) with the first one. */
+    static rem_res_t const conf_res = {
+        .address      = USECASE_BACKEND_ADDR,
+        .port         = USECASE_BACKEND_PORT,
+        .res_location = USECASE_BACKEND_CONF_RESSOURCE
+    };
+
+    transdrv_t *conf_recv = NULL;
+    res = publisher_init(&conf_recv, &conf_res, 1);
+    if (res) {
+        DERR("cannot init configuration receiver: %s\n", strerror(res));
+        return -1;
+    }
+#endif
 #endif
 
 #if CONDALF_USE_LTB == 1
@@ -264,23 +489,6 @@ int usecase(void)
         DERR("cannot init LTB: %s\n", strerror(res));
         return -1;
     }
-#if CONDALF_USE_RDLOG == 1
-    /* Configure the RDLOG to use the previously created LTB */
-    res = RDLOG_enable(
-        ltb, // bind the transfer driver. If NULL, it will only print locally.
-        rdlog_timef, // bind the time-stamp function; mandatory
-        USECASE_INFLUXDB":"USECASE_INSTANCE":" // set the prefix for record names
-        );
-    if (res) {
-        DERR("cannot init RDLOG: %d\n", res);
-    }
-#endif
-#elif CONDALF_USE_PUBLISHER == 1 && CONDALF_USE_RDLOG == 1
-    /* Configure the RDLOG to use the previously created publisher directly */
-    res = RDLOG_enable(sender, rdlog_timef, USECASE_INFLUXDB":"USECASE_INSTANCE":");
-    if (res) {
-        DERR("cannot init RDLOG: %d\n", res);
-    }
 #endif
 
     DINF("%u\n", __LINE__);
@@ -288,9 +496,15 @@ int usecase(void)
     /* Finally, we create the logger. */
     logg_init_t logg_init = {
         .name = "data",
-        .record_queue_size = ENCODING_QUEUELEN,
-        .encoding_buf_size = ENCODING_BUFSIZE,
+        .record_queue_size = logg_queue_len,
+        .encoding_buf_size = logg_buf_size,
         .base_name = USECASE_INFLUXDB":"USECASE_INSTANCE":", // set the prefix for record names
+        /* Don't keep records in RAM for longer than 15 minutes, should the
+         * sampling period be set to a high value. */
+        .max_latency = 15 * 60,
+        /* Let the logger balance its queue and buffer within the initial
+         * footprint. A remote configuration sets new starting sizes. */
+        .flags = LOGGERF_AUTOTUNE,
 #if CONDALF_USE_LTB == 1
         /* If using LTB, bind it... */
         .driv = ltb
@@ -307,6 +521,35 @@ int usecase(void)
         return -1;
     }
 
+#if CONDALF_USE_RDLOG == 1
+    /* Configure the RDLOG to put its records in the packs of the data logger,
+     * instead of producing packs of its own. */
+    res = RDLOG_enable_aggr(
+        logger, // the logger to share the packs with
+        rdlog_timef, // bind the time-stamp function; mandatory
+        USECASE_INFLUXDB":"USECASE_INSTANCE":" // set the prefix for record names
+        );
+    if (res) {
+        DERR("cannot init RDLOG: %d\n", res);
+    }
+#endif
+
+    /* The samples hardly change between two probes. Only log the changes,
+     * and every 10 minutes a sign of life. */
+    recfilt_init_t const filt_init = {
+        .next = logger,
+        .name = "changes",
+        .abs_deadband = 1,
+        .heartbeat = 10 * 60
+    };
+
+    recstr_t *filter = NULL;
+    res = recfilt_create(&filt_init, &filter);
+    if (res) {
+        DERR("cannot init filter: %d\n", res);
+        return -1;
+    }
+
     if (adc_init(LIGHT_ADC_LINE)) {
         DERR("cannot init light adc\n");
         return -1;
@@ -317,71 +560,37 @@ int usecase(void)
         return -1;
     }
 
-    while (!must_stop) {
-        int32_t light_sample = adc_sample(LIGHT_ADC_LINE, ADC_RES_10BIT);
-        int32_t temp_sample  = adc_sample(TEMP_ADC_LINE, ADC_RES_10BIT);
-
-        /* percentile light */
-        light_sample = light_sample * 100 / 1024;
-        /* voltage in mV */
-        temp_sample = temp_sample * 3300 / 1024;
-        /* LM35: 10mv / degree Celsius */
-        temp_sample = temp_sample / 10;
-        /* for some mysterious reason, the LM35 is outputting exactly half the
-         * real temperature.
-         * The ADC measures 0 for GND and 1023 for 3.3V */
-        temp_sample *= 2;
-
-        static int32_t sum_light = 0;
-        static int32_t sum_temp  = 0;
-
-        sum_light = sum_light - (sum_light / 10) + light_sample;
-        sum_temp  = sum_temp - (sum_temp / 10) + temp_sample;
-
-        DDBG("ADC: light=%i%%(%i), temp=%i°C(%i)\n",
-            light_sample, sum_light / 10, temp_sample, sum_temp / 10);
-
-        uint64_t unixtime = sntp_get_unix_usec();
-
-        /* Create a sample of integer type */
-        record_t sample = {
-            .type = RECORDTYPE_I32,
-        };
-        /* Set the time-stamp */
-        sample.timestamp.microseconds = unixtime % US_PER_SEC;
-        sample.timestamp.seconds      = unixtime / US_PER_SEC;
-
-        if (time_is_set) {
-            /* no way our light diode gives us any accurate values, so we'll go
-             * for percentile light. Anyway, InfluxDB ignores it. */
-            sample.unit = RECORDUNIT_percent;
-            sample.name = "light";
-            sample.i32  = light_sample;
-
-            /* Log the sample using the created logger. */
-            res = recstr_put(logger, &sample);
-
-            if (res) {
-                DERR("restr_put() failed: %s\n", strerror(res));
-                return -1;
-            }
-
-            sample.unit = RECORDUNIT_Cel;
-            sample.name = "temp";
-            sample.i32  = temp_sample;
+    /* Sample both sensors every probing period, with a common time-stamp.
+     * Without a valid time, the samplings are skipped. */
+    sampler_init_t const smp_init = {
+        .next  = filter,
+        .timef = rdlog_timef
+    };
 
-            res = recstr_put(logger, &sample);
+    res = sampler_create(&smp_init, &sampler);
+    if (res) {
+        DERR("cannot init sampler: %d\n", res);
+        return -1;
+    }
 
-            if (res) {
-                DERR("restr_put() failed: %s\n", strerror(res));
-                return -1;
-            }
+    res = sampler_add(sampler, &light_chan);
+    if (!res) res = sampler_add(sampler, &temp_chan);
+    if (res) {
+        DERR("cannot add the sensor channels: %d\n", res);
+        return -1;
+    }
 
-        } else {
-            DWRN("Time invalid, record skipped.\n");
+    while (!must_stop) {
+#if CONDALF_USE_PUBLISHER == 1 && defined(USECASE_BACKEND_CONF_RESSOURCE)
+        static uint32_t next_conf = 0;
+        uint32_t const now = rdlog_timef().seconds;
+        if (now && now >= next_conf) {
+            remconf_update(conf_recv, logger);
+            next_conf = now + REMCONF_PERIOD;
         }
+#endif
 
-        xtimer_usleep(PROBING_PERIOD);
+        xtimer_sleep(PROBING_PERIOD);
     }
 
 
@@ -391,6 +600,8 @@ int usecase(void)
 #if CONDALF_USE_RDLOG == 1
     RDLOG_disable();
 #endif
+    sampler_delete(&sampler);
+    recstr_close(&filter);
     recstr_close(&logger);
 
 #if CONDALF_USE_LTB == 1
@@ -399,8 +610,11 @@ int usecase(void)
 #endif
 
 #if CONDALF_USE_PUBLISHER == 1
-    /* Finally, close the sender */
+    /* Finally, close the senders */
     transdrv_delete(&sender);
+#ifdef USECASE_BACKEND_CONF_RESSOURCE
+    transdrv_delete(&conf_recv);
+#endif
 #endif
 
     DWRN("=====================\n");